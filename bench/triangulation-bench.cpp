@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "triangulation.h"
+
+
+/** Standalone benchmark of triangulation pipeline, without JVM and Vulkan.
+ * Runs every generator for input sizes from 1k up to --max-vertices (10M by default) and prints statistics of every stage as JSON:
+ *   decomposition_viewer_jni_bench [--max-vertices N] [--repeats N] [--workers N] [--generators name,name...]
+ * Generators are deterministic on every platform, so results of different builds are comparable.
+ */
+
+
+
+using Polygons = std::vector<std::vector<glm::dvec2>>;
+
+
+/** Splitmix sequence, unlike standard distributions it yields the same numbers with every standard library */
+class Random {
+    uint64_t state;
+
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        return mixHash(state += 0x9e3779b97f4a7c15ULL);
+    }
+
+    double uniform(double min, double max) {
+        return min + (double) (next() >> 11) * 0x1.0p-53 * (max - min);
+    }
+};
+
+
+static constexpr double PI = 3.14159265358979323846;
+
+
+/** Star-shaped polygon with random radius at every one of evenly spaced angles, which makes it simple */
+static std::vector<glm::dvec2> createRandomStarShape(Random& random, glm::dvec2 center, double minRadius, double maxRadius,
+        size_t vertexCount) {
+    std::vector<glm::dvec2> polygon(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        double angle = 2 * PI * (double) i / (double) vertexCount;
+        polygon[i] = center + glm::dvec2(std::cos(angle), std::sin(angle)) * random.uniform(minRadius, maxRadius);
+    }
+    return polygon;
+}
+
+
+/** Places polygons on jittered square grid with given spacing, so that neighbours overlap only when polygons are larger */
+static glm::dvec2 getGridCell(Random& random, size_t index, size_t polygonCount, double spacing) {
+    auto columns = (size_t) std::ceil(std::sqrt((double) polygonCount));
+    return glm::dvec2((double) (index % columns), (double) (index / columns)) * spacing +
+           glm::dvec2(random.uniform(-0.1, 0.1), random.uniform(-0.1, 0.1)) * spacing;
+}
+
+
+/** Large simple polygons of 4096 vertices, partially overlapping each other */
+static Polygons generateRandomSimple(size_t vertexCount) {
+    Random random(1);
+    size_t polygonSize = std::min<size_t>(vertexCount, 4096), polygonCount = (vertexCount + polygonSize - 1) / polygonSize;
+    Polygons polygons;
+    for (size_t i = 0; i < polygonCount; i++) {
+        polygons.push_back(createRandomStarShape(random, getGridCell(random, i, polygonCount, 1.5), 0.5, 1, polygonSize));
+    }
+    return polygons;
+}
+
+
+/** Star polygons {61/q}, every edge crosses 2 * (q - 1) others, overlapping their neighbours */
+static Polygons generateSelfIntersectingStars(size_t vertexCount) {
+    Random random(2);
+    const size_t points = 61;
+    size_t polygonCount = std::max<size_t>(vertexCount / points, 1);
+    Polygons polygons;
+    for (size_t i = 0; i < polygonCount; i++) {
+        glm::dvec2 center = getGridCell(random, i, polygonCount, 1.5);
+        auto step = (size_t) (2 + random.next() % 4);
+        double rotation = random.uniform(0, 2 * PI);
+        std::vector<glm::dvec2>& polygon = polygons.emplace_back(points);
+        for (size_t j = 0; j < points; j++) {
+            double angle = rotation + 2 * PI * (double) (j * step % points) / (double) points;
+            polygon[j] = center + glm::dvec2(std::cos(angle), std::sin(angle));
+        }
+    }
+    return polygons;
+}
+
+
+/** Disjoint nests of 16 concentric rings of 256 vertices, orientation alternates, so every other ring is a hole */
+static Polygons generateNestedHoles(size_t vertexCount) {
+    Random random(3);
+    const size_t ringSize = 256, depth = 16;
+    size_t ringCount = std::max<size_t>(vertexCount / ringSize, 1), nestCount = (ringCount + depth - 1) / depth;
+    Polygons polygons;
+    for (size_t ring = 0; ring < ringCount; ring++) {
+        glm::dvec2 center = getGridCell(random, ring / depth, nestCount, 3);
+        double radius = 1 - (double) (ring % depth) / depth;
+        // Rings are 1 / depth apart, so radius varies less than that to keep them disjoint
+        std::vector<glm::dvec2> polygon = createRandomStarShape(random, center, radius - 0.5 / depth, radius, ringSize);
+        if(ring % 2 == 1) std::reverse(polygon.begin(), polygon.end());
+        polygons.push_back(std::move(polygon));
+    }
+    return polygons;
+}
+
+
+/** Squares with 16 collinear vertices per side, each one overlapping its 8 neighbours, so everything is one group */
+static Polygons generateOverlappingGrids(size_t vertexCount) {
+    Random random(4);
+    const size_t sideVertices = 16;
+    size_t polygonCount = std::max<size_t>(vertexCount / (4 * sideVertices), 1);
+    Polygons polygons;
+    for (size_t i = 0; i < polygonCount; i++) {
+        glm::dvec2 corner = getGridCell(random, i, polygonCount, 1);
+        const glm::dvec2 directions[] {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+        std::vector<glm::dvec2>& polygon = polygons.emplace_back();
+        glm::dvec2 vertex = corner;
+        for(glm::dvec2 direction : directions) {
+            for (size_t j = 0; j < sideVertices; j++) {
+                polygon.push_back(vertex);
+                vertex += direction * (1.5 / sideVertices);
+            }
+        }
+    }
+    return polygons;
+}
+
+
+/** Small polygons of 16 vertices far apart from each other, so every one is its own group */
+static Polygons generateDisjointIslands(size_t vertexCount) {
+    Random random(5);
+    const size_t islandSize = 16;
+    size_t polygonCount = std::max<size_t>(vertexCount / islandSize, 1);
+    Polygons polygons;
+    for (size_t i = 0; i < polygonCount; i++) {
+        polygons.push_back(createRandomStarShape(random, getGridCell(random, i, polygonCount, 3), 0.5, 1, islandSize));
+    }
+    return polygons;
+}
+
+
+
+struct Generator {
+    const char* name;
+    Polygons (*generate)(size_t vertexCount);
+};
+
+static const Generator generators[] {
+        {"random-simple", generateRandomSimple},
+        {"self-intersecting-stars", generateSelfIntersectingStars},
+        {"nested-holes", generateNestedHoles},
+        {"overlapping-grids", generateOverlappingGrids},
+        {"disjoint-islands", generateDisjointIslands}
+};
+
+static const char* const stageNames[] {
+        "steinerVertices", "graphDecomposition", "polygonTrees", "polygonAreaTrees", "triangulation"
+};
+
+
+struct Run {
+    double totalMilliseconds;
+    TriangulationStatistics statistics;
+};
+
+
+static double measureMilliseconds(const std::function<void()>& task) {
+    auto start = std::chrono::steady_clock::now();
+    task();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+/** Loops the renderer used before vertex kernels, converting vertex by vertex and wrapping edges with modulo,
+ * reported first as a baseline for the kernel sets
+ */
+static const VertexKernels baselineKernels {
+        "baseline",
+        [](const glm::dvec2* source, glm::vec2* destination, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                destination[i] = glm::vec2(source[i]);
+            }
+        },
+        [](const glm::dvec2* polygon, glm::vec2* destination, size_t count) {
+            size_t counter = 0;
+            for (size_t i = 0; i < count; i++) {
+                glm::dvec2 vertex = polygon[i];
+                glm::dvec2 nextVertex = polygon[(i + 1) % count];
+                destination[counter] = glm::vec2(vertex);
+                destination[counter + 1] = glm::vec2(nextVertex);
+                counter += 2;
+            }
+        },
+        [](const glm::dvec2* vertices, size_t count, glm::dvec2& min, glm::dvec2& max) {
+            min = max = vertices[0];
+            for (size_t i = 0; i < count; i++) {
+                min = glm::min(min, vertices[i]);
+                max = glm::max(max, vertices[i]);
+            }
+        }
+};
+
+
+/** Times baseline loops and every supported kernel set on the given vertices, each kernel is repeated until it runs for at least 50 ms */
+static void printVertexKernels(std::ostream& out, const Polygons& polygons) {
+    std::vector<glm::dvec2> vertices;
+    for(const std::vector<glm::dvec2>& polygon : polygons) vertices.insert(vertices.end(), polygon.begin(), polygon.end());
+    std::vector<glm::vec2> destination(vertices.size() * 2);
+    auto measure = [&](const std::function<void()>& kernel) {
+        size_t iterations = 0;
+        double milliseconds = 0;
+        while(milliseconds < 50) {
+            milliseconds += measureMilliseconds(kernel);
+            iterations++;
+        }
+        return milliseconds / (double) iterations;
+    };
+
+    out << "  \"vertexKernels\": {\n    \"vertices\": " << vertices.size() << ",\n    \"kernels\": [";
+    std::vector<const VertexKernels*> kernels = getSupportedVertexKernels();
+    kernels.insert(kernels.begin(), &baselineKernels);
+    for (size_t i = 0; i < kernels.size(); i++) {
+        const VertexKernels& k = *kernels[i];
+        glm::dvec2 min, max;
+        out << (i == 0 ? "" : ",") << "\n      {\"name\": \"" << k.name << "\"" <<
+            ", \"narrowMs\": " << measure([&]() { k.narrow(vertices.data(), destination.data(), vertices.size()); }) <<
+            ", \"expandEdgesMs\": " << measure([&]() { k.expandEdges(vertices.data(), destination.data(), vertices.size()); }) <<
+            ", \"computeBoundsMs\": " << measure([&]() { k.computeBounds(vertices.data(), vertices.size(), min, max); }) << "}";
+    }
+    out << "\n    ]\n  },\n";
+}
+
+
+int main(int argc, char** argv) {
+    size_t maxVertices = 10'000'000, repeats = 3;
+    unsigned int workerCount = 1;
+    std::string generatorFilter;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if(i + 1 >= argc) {
+            std::cerr << "Missing value of " << argument << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if(argument == "--max-vertices") maxVertices = std::stoull(value);
+        else if(argument == "--repeats") repeats = std::max<size_t>(std::stoull(value), 1);
+        else if(argument == "--workers") workerCount = (unsigned int) std::stoul(value);
+        else if(argument == "--generators") generatorFilter = "," + value + ",";
+        else {
+            std::cerr << "Unknown argument " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    std::ostream& out = std::cout;
+    out << "{\n  \"workers\": " << resolveWorkerCount(workerCount) << ",\n  \"repeats\": " << repeats << ",\n";
+    printVertexKernels(out, generateRandomSimple(std::min<size_t>(maxVertices, 1'000'000)));
+    out << "  \"results\": [";
+    bool first = true;
+    for(const Generator& generator : generators) {
+        if(!generatorFilter.empty() && generatorFilter.find("," + std::string(generator.name) + ",") == std::string::npos) continue;
+        for (size_t vertexCount = 1000; vertexCount <= maxVertices; vertexCount *= 10) {
+            Polygons polygons = generator.generate(vertexCount);
+
+            std::vector<Run> runs;
+            for (size_t repeat = 0; repeat < repeats; repeat++) {
+                Run& run = runs.emplace_back();
+                run.totalMilliseconds = measureMilliseconds([&]() {
+                    run.statistics = Triangulation(polygons, workerCount).statistics;
+                });
+            }
+            // Median run by total time, with its own stage statistics, so that stages add up
+            std::sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) { return a.totalMilliseconds < b.totalMilliseconds; });
+            double medianMilliseconds = runs[runs.size() / 2].totalMilliseconds;
+            const TriangulationStatistics& median = runs[runs.size() / 2].statistics;
+
+            out << (first ? "" : ",") << "\n    {\"generator\": \"" << generator.name << "\", \"targetVertices\": " << vertexCount <<
+                ", \"polygons\": " << median.polygons << ", \"groups\": " << median.groups <<
+                ", \"inputVertices\": " << median.inputVertices << ", \"steinerVertices\": " << median.steinerVertices <<
+                ", \"treeNodes\": " << median.treeNodes << ", \"triangles\": " << median.triangles <<
+                ", \"totalMs\": " << medianMilliseconds << ", \"minTotalMs\": " << runs.front().totalMilliseconds <<
+                ", \"stages\": {";
+            for (size_t i = 0; i < TriangulationStatistics::STAGE_COUNT; i++) {
+                const TriangulationStatistics::Stage& stage = median.stages[i];
+                out << (i == 0 ? "" : ", ") << "\"" << stageNames[i] << "\": {\"ms\": " << stage.milliseconds <<
+                    ", \"heapGrowthBytes\": " << stage.heapGrowthBytes << ", \"elements\": " << stage.elements << "}";
+            }
+            out << "}}" << std::flush;
+            first = false;
+        }
+    }
+    out << "\n  ]\n}" << std::endl;
+    return 0;
+}
\ No newline at end of file
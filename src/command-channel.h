@@ -0,0 +1,261 @@
+#pragma once
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm.hpp>
+
+
+
+/** Single producer, single consumer byte ring in memory shared with Java through direct ByteBuffer.
+ * Buffer starts with 64 byte header holding write and read offsets into data, which follows the header.
+ * Records start with type and size (including this 8 byte prefix), their size is a multiple of 8 and they never wrap:
+ * writer places PADDING record at the end of data instead and continues from the beginning.
+ * Ring is empty when both offsets are equal, so writer always leaves at least 8 bytes free.
+ * Offsets are read and written only within JNI calls, which order memory accesses of both sides.
+ */
+class SharedRing {
+
+    struct Header {
+        uint32_t write;
+        uint32_t read;
+    };
+
+    uint8_t* memory {nullptr};
+    uint32_t capacity {0};
+
+    [[nodiscard]] Header& header() const { return *(Header*) memory; }
+    [[nodiscard]] uint8_t* data(uint32_t offset) const { return memory + HEADER_SIZE + offset; }
+
+public:
+    static constexpr uint32_t HEADER_SIZE = 64, PADDING = 0;
+
+    struct Record {
+        uint32_t type;
+        uint32_t size;
+    };
+
+    SharedRing() = default;
+    SharedRing(void* memory, int64_t size) : memory((uint8_t*) memory) {
+        if(memory == nullptr || ((uintptr_t) memory & 7) != 0) throw std::invalid_argument("Ring buffer must be direct and aligned to 8 bytes");
+        if(size < HEADER_SIZE + 64 || size - HEADER_SIZE > UINT32_MAX) throw std::invalid_argument("Invalid ring buffer size");
+        capacity = (uint32_t) (size - HEADER_SIZE) / 8 * 8;
+        if(header().write >= capacity || header().read >= capacity || (header().write & 7) != 0 || (header().read & 7) != 0)
+            throw std::invalid_argument("Invalid ring buffer offsets");
+    }
+
+    /** Returns next record without consuming it, or nullptr when ring is empty */
+    [[nodiscard]] const Record* peek() {
+        Header& h = header();
+        while(h.read != h.write) {
+            auto record = (const Record*) data(h.read);
+            if(h.read + sizeof(Record) > capacity) throw std::runtime_error("Corrupted command stream");
+            if(record->size < sizeof(Record) || (record->size & 7) != 0 || h.read + record->size > capacity)
+                throw std::runtime_error("Corrupted command stream");
+            if(record->type != PADDING) return record;
+            h.read = h.read + record->size == capacity ? 0 : h.read + record->size;
+        }
+        return nullptr;
+    }
+
+    void consume(const Record* record) {
+        Header& h = header();
+        h.read = h.read + record->size == capacity ? 0 : h.read + record->size;
+    }
+
+    /** Reserves record of given payload size, or returns nullptr when there is not enough free space */
+    [[nodiscard]] Record* allocate(uint32_t type, uint32_t payloadSize) {
+        Header& h = header();
+        uint32_t size = (uint32_t) (sizeof(Record) + payloadSize + 7) / 8 * 8;
+        uint32_t write = h.write;
+        if(write + size > capacity) {
+            // Record doesn't fit before the end, so the tail is padded, unless reader is still there
+            if(h.read > write || h.read == 0 || size >= h.read) return nullptr;
+            *(Record*) data(write) = {PADDING, capacity - write};
+            h.write = write = 0;
+        }
+        uint32_t free = h.read > write ? h.read - write : capacity - write + h.read;
+        if(size >= free) return nullptr;
+        auto record = (Record*) data(write);
+        *record = {type, size};
+        return record;
+    }
+
+    void commit(const Record* record) {
+        Header& h = header();
+        h.write = h.write + record->size == capacity ? 0 : h.write + record->size;
+    }
+
+    explicit operator bool() const { return memory != nullptr; }
+
+};
+
+
+
+/** Decodes batches of edits and queries written by Java into command ring, replacing a JNI call per operation.
+ * Polygon set is edited in place, triangulation and painting are delegated to handler. Results are written into
+ * result ring, when it gets full, decoding stops and the rest of commands is left for the next flush.
+ */
+class CommandChannel {
+public:
+
+    enum Command : uint32_t {
+        /// int32 polygon, int32 vertex count, double[2 * vertex count] coordinates. Polygon equal to polygon count appends
+        SET_POLYGON = 1,
+        /// int32 polygon, int32 unused
+        REMOVE_POLYGON = 2,
+        /// int32 polygon, int32 vertex, double x, double y
+        MOVE_VERTEX = 3,
+        /// No payload
+        CLEAR = 4,
+        /// No payload, answered by TRIANGULATED
+        TRIANGULATE = 5,
+        /// double scale x, double scale y, double offset x, double offset y, answered by PAINTED
+        PAINT = 6
+    };
+
+    enum Result : uint32_t {
+        /// uint64 triangulation id, int32 vertex count, int32 triangle count
+        TRIANGULATED = 1,
+        /// No payload
+        PAINTED = 2,
+        /// int32 index of failed command within flush, int32 message length, UTF-8 message
+        FAILED = 3
+    };
+
+    struct Triangulated {
+        uint64_t id;
+        int32_t vertexCount, triangleCount;
+    };
+
+    class Handler {
+    public:
+        /** Called before triangulation or painting, and at the end of flush, if polygons were edited since the last call */
+        virtual void polygonsChanged() = 0;
+        virtual Triangulated triangulate() = 0;
+        virtual void paint(glm::dvec2 scale, glm::dvec2 offset) = 0;
+        virtual ~Handler() = default;
+    };
+
+    SharedRing commands, results;
+
+
+    CommandChannel(SharedRing commands, SharedRing results) : commands(commands), results(results) {}
+
+    /** Executes commands in order, returns number of executed commands. Failure of a single command is reported
+     * through result ring and doesn't stop the rest, only corrupted stream throws.
+     */
+    uint32_t flush(std::vector<std::vector<glm::dvec2>>& polygons, Handler& handler) {
+        uint32_t executed = 0;
+        bool changed = false;
+        auto notifyChanged = [&]() {
+            if(changed) handler.polygonsChanged();
+            changed = false;
+        };
+        while(const SharedRing::Record* record = commands.peek()) {
+            // Every command may produce a result or failure, so there must be room for the largest one
+            if(!hasRoomForResult()) break;
+            const uint8_t* payload = (const uint8_t*) (record + 1);
+            uint32_t payloadSize = record->size - sizeof(SharedRing::Record);
+            try {
+                switch(record->type) {
+                    case SET_POLYGON: {
+                        auto [polygon, vertexCount] = read<int32_t, int32_t>(payload, payloadSize);
+                        if(vertexCount < 0 || (uint64_t) vertexCount * sizeof(glm::dvec2) > payloadSize - 8)
+                            throw std::invalid_argument("Invalid vertex count");
+                        std::vector<glm::dvec2>& target = polygonAt(polygons, polygon, true);
+                        target.resize(vertexCount);
+                        std::memcpy(target.data(), payload + 8, vertexCount * sizeof(glm::dvec2));
+                        changed = true;
+                        break;
+                    }
+                    case REMOVE_POLYGON: {
+                        auto [polygon, unused] = read<int32_t, int32_t>(payload, payloadSize);
+                        polygonAt(polygons, polygon, false);
+                        polygons.erase(polygons.begin() + polygon);
+                        changed = true;
+                        break;
+                    }
+                    case MOVE_VERTEX: {
+                        auto [polygon, vertex] = read<int32_t, int32_t>(payload, payloadSize);
+                        if(payloadSize < 24) throw std::invalid_argument("Truncated command");
+                        std::vector<glm::dvec2>& target = polygonAt(polygons, polygon, false);
+                        if(vertex < 0 || vertex >= (int32_t) target.size()) throw std::out_of_range("Vertex index out of range");
+                        std::memcpy(&target[vertex], payload + 8, sizeof(glm::dvec2));
+                        changed = true;
+                        break;
+                    }
+                    case CLEAR:
+                        polygons.clear();
+                        changed = true;
+                        break;
+                    case TRIANGULATE: {
+                        notifyChanged();
+                        Triangulated triangulated = handler.triangulate();
+                        SharedRing::Record* result = results.allocate(TRIANGULATED, sizeof(Triangulated));
+                        std::memcpy(result + 1, &triangulated, sizeof(Triangulated));
+                        results.commit(result);
+                        break;
+                    }
+                    case PAINT: {
+                        if(payloadSize < 32) throw std::invalid_argument("Truncated command");
+                        double view[4];
+                        std::memcpy(view, payload, sizeof(view));
+                        notifyChanged();
+                        handler.paint({view[0], view[1]}, {view[2], view[3]});
+                        results.commit(results.allocate(PAINTED, 0));
+                        break;
+                    }
+                    default:
+                        throw std::invalid_argument("Unknown command " + std::to_string(record->type));
+                }
+            } catch(std::exception& e) {
+                writeFailure(executed, e.what());
+            }
+            commands.consume(record);
+            executed++;
+        }
+        notifyChanged();
+        return executed;
+    }
+
+
+private:
+    static constexpr uint32_t MAX_MESSAGE_LENGTH = 240;
+
+    [[nodiscard]] bool hasRoomForResult() {
+        SharedRing::Record* record = results.allocate(FAILED, 8 + MAX_MESSAGE_LENGTH);
+        return record != nullptr;
+    }
+
+    void writeFailure(uint32_t command, const char* message) {
+        auto length = (uint32_t) std::min<size_t>(std::strlen(message), MAX_MESSAGE_LENGTH);
+        SharedRing::Record* result = results.allocate(FAILED, 8 + length);
+        int32_t header[2] {(int32_t) command, (int32_t) length};
+        std::memcpy(result + 1, header, sizeof(header));
+        std::memcpy((uint8_t*) (result + 1) + 8, message, length);
+        results.commit(result);
+    }
+
+    template <typename A, typename B>
+    static std::pair<A, B> read(const uint8_t* payload, uint32_t payloadSize) {
+        if(payloadSize < sizeof(A) + sizeof(B)) throw std::invalid_argument("Truncated command");
+        std::pair<A, B> result;
+        std::memcpy(&result.first, payload, sizeof(A));
+        std::memcpy(&result.second, payload + sizeof(A), sizeof(B));
+        return result;
+    }
+
+    static std::vector<glm::dvec2>& polygonAt(std::vector<std::vector<glm::dvec2>>& polygons, int32_t polygon, bool append) {
+        if(append && polygon == (int32_t) polygons.size()) return polygons.emplace_back();
+        if(polygon < 0 || polygon >= (int32_t) polygons.size()) throw std::out_of_range("Polygon index out of range");
+        return polygons[polygon];
+    }
+
+};
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+
+#include <cstdint>
+#include <vector>
+
+#include "decomposition.h"
+
+
+
+/** Forest of polygon trees stored as nodes in preorder, vertex indices of all nodes share one pool.
+ * Subtree of a node occupies subtreeSize nodes starting at the node itself, so its first child (if any) is the next node
+ * and next sibling follows its subtree. Counting and visiting all nodes is then a plain loop.
+ */
+struct FlatPolygonTree {
+
+    struct Node {
+        int netWinding;
+        uint32_t childCount;
+        uint32_t subtreeSize;
+        uint32_t firstIndex, indexCount;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> indices;
+
+
+    FlatPolygonTree() = default;
+
+    explicit FlatPolygonTree(const std::vector<decomposition::PolygonTree>& trees) {
+        for(const decomposition::PolygonTree& tree : trees) append(tree);
+    }
+
+
+    [[nodiscard]] size_t size() const {
+        return nodes.size();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return nodes.empty();
+    }
+
+    [[nodiscard]] const int* getVertexIndices(const Node& node) const {
+        return indices.data() + node.firstIndex;
+    }
+
+    [[nodiscard]] size_t getMemoryUsage() const {
+        return nodes.capacity() * sizeof(Node) + indices.capacity() * sizeof(int);
+    }
+
+
+    /** Copies all nodes of source into already allocated range starting at given node and index, mapping its vertex indices.
+     * Ranges of different sources don't overlap, so they can be filled in parallel.
+     */
+    void assign(size_t nodeOffset, size_t indexOffset, const FlatPolygonTree& source, const std::vector<int>& indexMap) {
+        for (size_t node = 0; node < source.nodes.size(); node++) {
+            Node& target = nodes[nodeOffset + node];
+            target = source.nodes[node];
+            target.firstIndex += (uint32_t) indexOffset;
+        }
+        for (size_t index = 0; index < source.indices.size(); index++) indices[indexOffset + index] = indexMap[source.indices[index]];
+    }
+
+
+    /** Every node as: netWinding, childrenCount, vertexCount, vertexIndices... */
+    [[nodiscard]] std::vector<int> serialize() const {
+        std::vector<int> result;
+        result.reserve(nodes.size() * 3 + indices.size());
+        for(const Node& node : nodes) {
+            result.insert(result.end(), {node.netWinding, (int) node.childCount, (int) node.indexCount});
+            result.insert(result.end(), getVertexIndices(node), getVertexIndices(node) + node.indexCount);
+        }
+        return result;
+    }
+
+
+private:
+    void append(const decomposition::PolygonTree& tree) {
+        size_t node = nodes.size();
+        nodes.push_back({
+                /*netWinding*/  tree.netWinding,
+                /*childCount*/  (uint32_t) tree.childrenPolygons.size(),
+                /*subtreeSize*/ 1,
+                /*firstIndex*/  (uint32_t) indices.size(),
+                /*indexCount*/  (uint32_t) tree.vertexIndices.size()
+        });
+        indices.insert(indices.end(), tree.vertexIndices.begin(), tree.vertexIndices.end());
+        for(const decomposition::PolygonTree& child : tree.childrenPolygons) append(child);
+        nodes[node].subtreeSize = (uint32_t) (nodes.size() - node);
+    }
+
+};
\ No newline at end of file
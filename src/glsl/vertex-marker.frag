@@ -0,0 +1,19 @@
+#version 450 core
+
+layout (constant_id = 0) const float color_r = 0;
+layout (constant_id = 1) const float color_g = 0;
+layout (constant_id = 2) const float color_b = 0;
+
+layout(location = 0) in vec2 in_local;
+
+layout(location = 0) out vec4 color;
+
+
+void main() {
+    // Signed distance to the circle edge, in units of radius, smoothed over about one pixel
+    float distance = length(in_local) - 1.0;
+    float width = fwidth(distance);
+    float alpha = 1.0 - smoothstep(-width, width, distance);
+    if(alpha <= 0.0) discard;
+    color = vec4(color_r, color_g, color_b, alpha);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 450 core
+
+layout(set = 0, binding = 0) uniform Uniform {
+    vec2 extent;
+    vec2 offset;
+} u;
+
+layout(push_constant) uniform PushConstants {
+    float radius;
+} p;
+
+layout(location = 0) in vec2 in_center;
+
+layout(location = 0) out vec2 out_local;
+
+// Quad is slightly larger than the circle, leaving room for anti-aliased edge
+#define QUAD_SIZE 1.25
+
+
+void main() {
+    out_local = vec2(float(gl_VertexIndex & 1), float(gl_VertexIndex >> 1)) * 2.0 - vec2(1.0);
+    out_local *= QUAD_SIZE;
+    vec2 center = (in_center - u.offset) / u.extent * 2.0 - vec2(1.0);
+    gl_Position = vec4(center + out_local * p.radius / u.extent, 0.0, 1.0);
+}
\ No newline at end of file
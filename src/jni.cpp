@@ -5,10 +5,18 @@
 #include "jclass.h"
 
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 
 #include "triangulation.h"
+#include "triangulation-job.h"
+#include "triangulation-cache.h"
 #include "vulkan/jawt-renderer.h"
+#include "vulkan/offscreen-renderer.h"
 
 
 struct JNIClasses : public JNIClassesBase {
@@ -27,6 +35,7 @@ struct JNIClasses : public JNIClassesBase {
     )
     JCLASS(PolygonSet, "yaaz/decomposition/viewer/polygon/PolygonSet",
            JFIELD(polygons, "polygons", "Ljava/util/List;")
+           JFIELD(generation, "generation", "J")
     )
     JCLASS(Polygon, "yaaz/decomposition/viewer/polygon/Polygon",
            JFIELD(vertices, "vertices", "Ljava/util/List;")
@@ -35,28 +44,66 @@ struct JNIClasses : public JNIClassesBase {
            JMETHOD(init, "<init>", "(J)V")
            JFIELD(address, "address", "J")
     )
+    JCLASS(TriangulationJob, "yaaz/decomposition/viewer/polygon/TriangulationJob",
+           JMETHOD(init, "<init>", "(J)V")
+           JFIELD(address, "address", "J")
+    )
+    JCLASS(TriangulationJobCallback, "yaaz/decomposition/viewer/polygon/TriangulationJob$Callback",
+           JMETHOD(onComplete, "onComplete", "(Lyaaz/decomposition/viewer/polygon/Triangulation;Ljava/lang/String;)V")
+    )
     JCLASS(DecomposedPolygon, "yaaz/decomposition/viewer/polygon/Triangulation$DecomposedPolygon",
            JMETHOD(init, "<init>", "(I[I)V")
     )
     JCLASS(Triangle, "yaaz/decomposition/viewer/polygon/Triangulation$Triangle",
            JMETHOD(init, "<init>", "(III)V")
     )
+    JCLASS(CacheStatistics, "yaaz/decomposition/viewer/polygon/Triangulation$CacheStatistics",
+           JMETHOD(init, "<init>", "(JJJJJJ)V")
+    )
+    JCLASS(TriangulationStatistics, "yaaz/decomposition/viewer/polygon/Triangulation$Statistics",
+           JMETHOD(init, "<init>", "(DJJJJJJJ[Lyaaz/decomposition/viewer/polygon/Triangulation$StageStatistics;)V")
+    )
+    JCLASS(StageStatistics, "yaaz/decomposition/viewer/polygon/Triangulation$StageStatistics",
+           JMETHOD(init, "<init>", "(Ljava/lang/String;DJJ)V")
+    )
     JCLASS(VulkanRenderer, "yaaz/decomposition/viewer/rendering/VulkanRenderer",
            JMETHOD(init, "<init>", "(J)V")
            JFIELD(nativeHandle, "nativeHandle", "J")
            JFIELD(polygonSet, "polygonSet", "Lyaaz/decomposition/viewer/polygon/PolygonSet;")
            JFIELD(triangulation, "triangulation", "Lyaaz/decomposition/viewer/polygon/Triangulation;")
     )
+    JCLASS(RendererStatistics, "yaaz/decomposition/viewer/rendering/VulkanRenderer$Statistics",
+           JMETHOD(init, "<init>", "([Lyaaz/decomposition/viewer/rendering/VulkanRenderer$PassStatistics;DD)V")
+    )
+    JCLASS(PassStatistics, "yaaz/decomposition/viewer/rendering/VulkanRenderer$PassStatistics",
+           JMETHOD(init, "<init>", "(Ljava/lang/String;DDDDD)V")
+    )
+    JCLASS(OffscreenRenderer, "yaaz/decomposition/viewer/rendering/OffscreenRenderer",
+           JMETHOD(init, "<init>", "(J)V")
+           JFIELD(nativeHandle, "nativeHandle", "J")
+    )
     JCLASS(NativeException, "yaaz/decomposition/viewer/NativeException",
            JMETHOD(init, "<init>", "(Ljava/lang/String;)V")
     )
+    JCLASS(IllegalArgumentException, "java/lang/IllegalArgumentException")
 
 }* JClass;
 
+static JavaVM* javaVM;
 
 
+
+/** Number of threads used to triangulate independent polygons, 0 means number of hardware threads. */
+static std::atomic<unsigned int> triangulationWorkerCount {1};
+
+static TriangulationCache triangulationCache {256L * 1024L * 1024L};
+
+
+
+/** Invalid arguments passed from Java are its own mistakes, so they become IllegalArgumentException */
 static void rethrowNativeException(JNIEnv* jni, std::exception& exception) {
-    jni->ThrowNew(JClass->NativeException, exception.what());
+    bool invalidArgument = dynamic_cast<std::invalid_argument*>(&exception) != nullptr;
+    jni->ThrowNew(invalidArgument ? (jclass) JClass->IllegalArgumentException : (jclass) JClass->NativeException, exception.what());
 }
 
 
@@ -87,26 +134,158 @@ static std::vector<std::vector<glm::dvec2>> convertJavaPolygonSet(JNIEnv* jni, j
 }
 
 
+static jsize getArrayLength(JNIEnv* jni, jarray array) {
+    if(array == nullptr) throw std::invalid_argument("Array must not be null");
+    return jni->GetArrayLength(array);
+}
+
+
+/** Pins primitive array contents with GetPrimitiveArrayCritical for the lifetime of the object.
+ * No other JNI functions may be called while it is alive, except for other critical array functions,
+ * so length is read by getArrayLength before any array is pinned.
+ */
+template <typename Type>
+class PrimitiveArrayCritical {
+    JNIEnv* const jni;
+    const jarray array;
+public:
+    const jsize length;
+    const Type* const data;
+
+    PrimitiveArrayCritical(JNIEnv* jni, jarray array, jsize length) : jni(jni), array(array), length(length),
+    data((const Type*) jni->GetPrimitiveArrayCritical(array, nullptr)) {
+        if(data == nullptr) throw std::runtime_error("Cannot access primitive array");
+    }
+    PrimitiveArrayCritical(const PrimitiveArrayCritical&) = delete;
+    PrimitiveArrayCritical& operator=(const PrimitiveArrayCritical&) = delete;
+    ~PrimitiveArrayCritical() {
+        jni->ReleasePrimitiveArrayCritical(array, (void*) data, JNI_ABORT);
+    }
+};
+
+
+/** Builds polygon set from flat arrays: coordinates are stored as x0, y0, x1, y1...
+ * and polygon i consists of vertices [polygonOffsets[i], polygonOffsets[i + 1]).
+ * Offsets must start at 0 and never decrease, and coordinates must hold exactly the vertices they cover.
+ */
+static std::vector<std::vector<glm::dvec2>> convertPolygonArrays(const jdouble* coordinates, jlong coordinateCount,
+        const jint* polygonOffsets, jsize polygonOffsetCount) {
+    if(polygonOffsetCount == 0) {
+        if(coordinateCount != 0) throw std::invalid_argument("Coordinates are given without polygon offsets");
+        return {};
+    }
+    if(polygonOffsets[0] != 0) throw std::invalid_argument("First polygon offset must be 0");
+    for (jsize i = 0; i < polygonOffsetCount - 1; i++) {
+        if(polygonOffsets[i] > polygonOffsets[i + 1]) throw std::invalid_argument("Polygon vertex count must not be negative");
+    }
+    if(coordinateCount != (jlong) polygonOffsets[polygonOffsetCount - 1] * 2) {
+        throw std::invalid_argument("Coordinate count must be twice the total vertex count of polygons");
+    }
+    std::vector<std::vector<glm::dvec2>> result;
+    result.reserve(polygonOffsetCount - 1);
+    for (jsize i = 0; i < polygonOffsetCount - 1; i++) {
+        jint begin = polygonOffsets[i], end = polygonOffsets[i + 1];
+        auto vertices = (const glm::dvec2*) (coordinates + (jlong) begin * 2);
+        result.emplace_back(vertices, vertices + (end - begin));
+    }
+    return result;
+}
+
+
+static std::vector<std::vector<glm::dvec2>> convertJavaPolygonArrays(JNIEnv* jni, jdoubleArray coordinates, jintArray polygonOffsets) {
+    jsize coordinateCount = getArrayLength(jni, coordinates), polygonOffsetCount = getArrayLength(jni, polygonOffsets);
+    PrimitiveArrayCritical<jdouble> coordinateArray(jni, coordinates, coordinateCount);
+    PrimitiveArrayCritical<jint> polygonOffsetArray(jni, polygonOffsets, polygonOffsetCount);
+    return convertPolygonArrays(coordinateArray.data, coordinateArray.length, polygonOffsetArray.data, polygonOffsetArray.length);
+}
+
+
+/** Java triangulation objects hold address of shared pointer, so that triangulations can be shared with cache. */
 static Triangulation* unwrapTriangulation(JNIEnv* jni, jobject javaTriangulationObject) {
     if(javaTriangulationObject == nullptr) return nullptr;
-    return (Triangulation*) jni->GetLongField(javaTriangulationObject, JClass->Triangulation.address);
+    return ((std::shared_ptr<Triangulation>*) jni->GetLongField(javaTriangulationObject, JClass->Triangulation.address))->get();
+}
+
+static jobject wrapTriangulation(JNIEnv* jni, const std::shared_ptr<Triangulation>& triangulation) {
+    auto reference = new std::shared_ptr<Triangulation>(triangulation);
+    jobject javaTriangulation = jni->NewObject(JClass->Triangulation, JClass->Triangulation.init, (jlong) reference);
+    if(javaTriangulation == nullptr) delete reference;
+    return javaTriangulation;
 }
 
 
-static void addSubtreeOfDebugPolygonsToJavaArray(JNIEnv* jni, const decomposition::PolygonTree& subtree,
-        jobjectArray& resultPolygons, int& addedPolygons) {
-    jintArray vertexIndices = jni->NewIntArray(subtree.vertexIndices.size());
-    jni->SetIntArrayRegion(vertexIndices, 0, subtree.vertexIndices.size(), (jint*) subtree.vertexIndices.data());
-    jobject javaPolygon = jni->NewObject(JClass->DecomposedPolygon, JClass->DecomposedPolygon.init, (jint) subtree.netWinding, vertexIndices);
-    jni->SetObjectArrayElement(resultPolygons, addedPolygons++, javaPolygon);
-    for(const decomposition::PolygonTree& subtreeChild : subtree.childrenPolygons) {
-        addSubtreeOfDebugPolygonsToJavaArray(jni, subtreeChild, resultPolygons, addedPolygons);
+static std::shared_ptr<Triangulation> createTriangulation(const std::vector<std::vector<glm::dvec2>>& polygons,
+        TriangulationProgress* progress = nullptr) {
+    Hash128 key = hashPolygonSet(polygons);
+    std::shared_ptr<Triangulation> triangulation = triangulationCache.get(key);
+    if(triangulation) {
+        // Cached triangulation skips all stages, observers of asynchronous job still expect them to finish
+        if(progress != nullptr) progress->enterStage(TriangulationProgress::DONE);
+        return triangulation;
     }
+    triangulation = std::make_shared<Triangulation>(polygons, triangulationWorkerCount, progress);
+    triangulationCache.put(key, triangulation);
+    return triangulation;
+}
+
+
+/** Wraps native memory into direct ByteBuffer without copying. Buffer is valid only while memory owner is alive,
+ * and its contents are in native byte order.
+ */
+static jobject wrapNativeMemory(JNIEnv* jni, const void* data, size_t size) {
+    static char emptyBufferAddress;
+    if(size == 0) data = &emptyBufferAddress;
+    jobject buffer = jni->NewDirectByteBuffer((void*) data, (jlong) size);
+    if(buffer == nullptr) throw std::runtime_error("Cannot create direct buffer");
+    return buffer;
+}
+
+
+static TriangulationJob* unwrapTriangulationJob(JNIEnv* jni, jobject javaTriangulationJobObject) {
+    if(javaTriangulationJobObject == nullptr) return nullptr;
+    return (TriangulationJob*) jni->GetLongField(javaTriangulationJobObject, JClass->TriangulationJob.address);
 }
-static int countPolygonsInTree(const std::vector<decomposition::PolygonTree>& tree) {
-    int count = tree.size();
-    for(const decomposition::PolygonTree& subtree : tree) count += countPolygonsInTree(subtree.childrenPolygons);
-    return count;
+
+
+/** Attaches native thread to JVM for the lifetime of the object. */
+class AttachedThread {
+    bool attached = false;
+public:
+    JNIEnv* jni = nullptr;
+
+    AttachedThread() {
+        if(javaVM->GetEnv((void**) &jni, JNI_VERSION) == JNI_EDETACHED) {
+            if(javaVM->AttachCurrentThread((void**) &jni, nullptr) != JNI_OK) throw std::runtime_error("Cannot attach thread to JVM");
+            attached = true;
+        }
+    }
+    AttachedThread(const AttachedThread&) = delete;
+    AttachedThread& operator=(const AttachedThread&) = delete;
+    ~AttachedThread() {
+        if(attached) javaVM->DetachCurrentThread();
+    }
+};
+
+
+/** Passes result of asynchronous triangulation to Java callback and releases global reference to it. */
+static void completeTriangulationJob(jobject callback, const std::shared_ptr<Triangulation>& triangulation,
+        const std::exception* error) {
+    try {
+        AttachedThread thread;
+        JNIEnv* jni = thread.jni;
+        jobject javaTriangulation = triangulation ? wrapTriangulation(jni, triangulation) : nullptr;
+        if(!jni->ExceptionCheck()) {
+            jstring message = error == nullptr ? nullptr : jni->NewStringUTF(error->what());
+            jni->CallVoidMethod(callback, JClass->TriangulationJobCallback.onComplete, javaTriangulation, message);
+        }
+        if(jni->ExceptionCheck()) {
+            jni->ExceptionDescribe();
+            jni->ExceptionClear();
+        }
+        jni->DeleteGlobalRef(callback);
+    } catch(std::exception& e) {
+        std::cerr << "Cannot complete triangulation job: " << e.what() << std::endl;
+    }
 }
 
 
@@ -116,8 +295,62 @@ static JAWTVulkanRenderer* unwrapVulkanRenderer(JNIEnv* jni, jobject javaVulkanR
 }
 
 
+static OffscreenVulkanRenderer* unwrapOffscreenRenderer(JNIEnv* jni, jobject javaOffscreenRenderer) {
+    if(javaOffscreenRenderer == nullptr) return nullptr;
+    return (OffscreenVulkanRenderer*) jni->GetLongField(javaOffscreenRenderer, JClass->OffscreenRenderer.nativeHandle);
+}
+
+
+static void updateBoundPolygonSet(JNIEnv* jni, BoundPolygonSet& polygonSet, jobject javaPolygonSetObject) {
+    jlong generation = javaPolygonSetObject == nullptr ? 0 : jni->GetLongField(javaPolygonSetObject, JClass->PolygonSet.generation);
+    bool sameSource = javaPolygonSetObject == nullptr ? polygonSet.source == nullptr :
+            polygonSet.source != nullptr && jni->IsSameObject(polygonSet.source, javaPolygonSetObject);
+    if(sameSource && polygonSet.sourceGeneration == generation) return;
+    if(javaPolygonSetObject == nullptr) polygonSet.polygons.clear();
+    else polygonSet.polygons = convertJavaPolygonSet(jni, javaPolygonSetObject);
+    if(polygonSet.source != nullptr) jni->DeleteWeakGlobalRef(polygonSet.source);
+    polygonSet.source = javaPolygonSetObject == nullptr ? nullptr : jni->NewWeakGlobalRef(javaPolygonSetObject);
+    polygonSet.sourceGeneration = generation;
+    polygonSet.version++;
+}
+
+
+/** Runs commands of channel bound to Java renderer against its polygon set */
+class RendererCommandHandler : public CommandChannel::Handler {
+    JNIEnv* jni;
+    jobject javaVulkanRenderer;
+    JAWTVulkanRenderer& renderer;
+
+public:
+    RendererCommandHandler(JNIEnv* jni, jobject javaVulkanRenderer, JAWTVulkanRenderer& renderer) :
+            jni(jni), javaVulkanRenderer(javaVulkanRenderer), renderer(renderer) {}
+
+    /** Polygons no longer match Java polygon set, so it will be converted again if Java paints it later */
+    void polygonsChanged() final {
+        BoundPolygonSet& polygonSet = renderer.polygonSet;
+        if(polygonSet.source != nullptr) jni->DeleteWeakGlobalRef(polygonSet.source);
+        polygonSet.source = nullptr;
+        polygonSet.sourceGeneration = 0;
+        polygonSet.version++;
+    }
+
+    CommandChannel::Triangulated triangulate() final {
+        renderer.commandTriangulation = createTriangulation(renderer.polygonSet.polygons);
+        const Triangulation& triangulation = *renderer.commandTriangulation;
+        return {triangulation.id, (int32_t) triangulation.vertices.size(), (int32_t) triangulation.triangles.size()};
+    }
+
+    void paint(glm::dvec2 scale, glm::dvec2 offset) final {
+        const Triangulation* triangulation = renderer.commandTriangulation ? renderer.commandTriangulation.get() :
+                unwrapTriangulation(jni, jni->GetObjectField(javaVulkanRenderer, JClass->VulkanRenderer.triangulation));
+        renderer.render(jni, javaVulkanRenderer, triangulation, scale, offset);
+    }
+};
+
+
 void initVulkan();
 void destroyVulkan();
+static void registerNatives(JNIEnv* jni);
 
 
 extern "C" {
@@ -126,8 +359,11 @@ extern "C" {
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void*) {
     JNIEnv* jni;
     vm->GetEnv((void**) &jni, JNI_VERSION);
+    javaVM = vm;
     try {
         JClass = new JNIClasses(jni);
+        registerNatives(jni);
+        TriangulationTrace::openFromEnvironment();
         initVulkan();
     } catch(std::exception& e) {
         rethrowNativeException(jni, e);
@@ -142,6 +378,7 @@ JNIEXPORT void JNICALL JNI_OnUnload(JavaVM* vm, void*) {
     try {
         JClass->setJni(jni);
         delete JClass;
+        TriangulationTrace::close();
         destroyVulkan();
     } catch(std::exception& e) {
         rethrowNativeException(jni, e);
@@ -161,8 +398,252 @@ JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_c
         (JNIEnv* jni, jclass, jobject polygonSet) {
     try {
         auto polygons = convertJavaPolygonSet(jni, polygonSet);
-        auto triangulation = new Triangulation(polygons);
-        return jni->NewObject(JClass->Triangulation, JClass->Triangulation.init, (jlong) triangulation);
+        return wrapTriangulation(jni, createTriangulation(polygons));
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    createAsync
+ * Signature: (Lyaaz/decomposition/viewer/polygon/PolygonSet;Lyaaz/decomposition/viewer/polygon/TriangulationJob/Callback;)Lyaaz/decomposition/viewer/polygon/TriangulationJob;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_createAsync
+        (JNIEnv* jni, jclass, jobject polygonSet, jobject callback) {
+    try {
+        if(callback == nullptr) throw std::invalid_argument("Triangulation callback must not be null");
+        auto polygons = convertJavaPolygonSet(jni, polygonSet);
+        jobject globalCallback = jni->NewGlobalRef(callback);
+        auto job = new TriangulationJob(
+                [polygons = std::move(polygons)](TriangulationProgress& progress) {
+                    return createTriangulation(polygons, &progress);
+                },
+                [globalCallback](std::shared_ptr<Triangulation> triangulation, const std::exception* error) {
+                    completeTriangulationJob(globalCallback, triangulation, error);
+                }
+        );
+        jobject javaJob = jni->NewObject(JClass->TriangulationJob, JClass->TriangulationJob.init, (jlong) job);
+        if(javaJob == nullptr) delete job;
+        return javaJob;
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    createFromArrays
+ * Signature: ([D[I)Lyaaz/decomposition/viewer/polygon/Triangulation;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_createFromArrays
+        (JNIEnv* jni, jclass, jdoubleArray coordinates, jintArray polygonOffsets) {
+    try {
+        auto polygons = convertJavaPolygonArrays(jni, coordinates, polygonOffsets);
+        return wrapTriangulation(jni, createTriangulation(polygons));
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    createFromBuffer
+ * Signature: (Ljava/nio/DoubleBuffer;[I)Lyaaz/decomposition/viewer/polygon/Triangulation;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_createFromBuffer
+        (JNIEnv* jni, jclass, jobject coordinates, jintArray polygonOffsets) {
+    try {
+        if(coordinates == nullptr) throw std::invalid_argument("Coordinate buffer must not be null");
+        auto coordinateData = (const jdouble*) jni->GetDirectBufferAddress(coordinates);
+        if(coordinateData == nullptr) throw std::invalid_argument("Coordinate buffer is not direct");
+        jlong coordinateCount = jni->GetDirectBufferCapacity(coordinates);
+        jsize polygonOffsetCount = getArrayLength(jni, polygonOffsets);
+        std::vector<std::vector<glm::dvec2>> polygons;
+        {
+            PrimitiveArrayCritical<jint> polygonOffsetArray(jni, polygonOffsets, polygonOffsetCount);
+            polygons = convertPolygonArrays(coordinateData, coordinateCount,
+                    polygonOffsetArray.data, polygonOffsetArray.length);
+        }
+        return wrapTriangulation(jni, createTriangulation(polygons));
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    benchmarkIngestion
+ * Signature: (Lyaaz/decomposition/viewer/polygon/PolygonSet;I)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_benchmarkIngestion
+        (JNIEnv* jni, jclass, jobject polygonSet, jint repeats) {
+    try {
+        // Converts the same polygons through list of Point2D objects and through flat arrays, returns median times as JSON
+        if(polygonSet == nullptr) throw std::invalid_argument("Polygon set must not be null");
+        if(repeats < 1) throw std::invalid_argument("Repeat count must be positive");
+        auto polygons = convertJavaPolygonSet(jni, polygonSet);
+        std::vector<jdouble> coordinates;
+        std::vector<jint> polygonOffsets {0};
+        for(const std::vector<glm::dvec2>& polygon : polygons) {
+            for(glm::dvec2 vertex : polygon) coordinates.insert(coordinates.end(), {vertex.x, vertex.y});
+            polygonOffsets.push_back(polygonOffsets.back() + (jint) polygon.size());
+        }
+        jdoubleArray javaCoordinates = jni->NewDoubleArray((jsize) coordinates.size());
+        jintArray javaPolygonOffsets = jni->NewIntArray((jsize) polygonOffsets.size());
+        if(javaCoordinates == nullptr || javaPolygonOffsets == nullptr) return nullptr;
+        jni->SetDoubleArrayRegion(javaCoordinates, 0, (jsize) coordinates.size(), coordinates.data());
+        jni->SetIntArrayRegion(javaPolygonOffsets, 0, (jsize) polygonOffsets.size(), polygonOffsets.data());
+
+        auto measure = [repeats](auto&& convert) {
+            std::vector<double> milliseconds;
+            for (jint i = 0; i < repeats; i++) {
+                auto start = std::chrono::steady_clock::now();
+                convert();
+                milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            std::sort(milliseconds.begin(), milliseconds.end());
+            return milliseconds[milliseconds.size() / 2];
+        };
+        double listMilliseconds = measure([&]() {
+            // List path leaves local reference to every visited object, they are released after each run
+            if(jni->PushLocalFrame(16) != JNI_OK) throw std::runtime_error("Cannot allocate local references");
+            convertJavaPolygonSet(jni, polygonSet);
+            jni->PopLocalFrame(nullptr);
+        });
+        double arrayMilliseconds = measure([&]() { convertJavaPolygonArrays(jni, javaCoordinates, javaPolygonOffsets); });
+
+        std::ostringstream json;
+        json << "{\"polygons\": " << polygons.size() << ", \"vertices\": " << coordinates.size() / 2 << ", \"repeats\": " << repeats <<
+             ", \"listMs\": " << listMilliseconds << ", \"arraysMs\": " << arrayMilliseconds << "}";
+        return jni->NewStringUTF(json.str().c_str());
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    update
+ * Signature: (Lyaaz/decomposition/viewer/polygon/PolygonSet;)Lyaaz/decomposition/viewer/polygon/Triangulation;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_update
+        (JNIEnv* jni, jobject javaTriangulationObject, jobject polygonSet) {
+    try {
+        Triangulation* previousTriangulation = unwrapTriangulation(jni, javaTriangulationObject);
+        auto polygons = convertJavaPolygonSet(jni, polygonSet);
+        Hash128 key = hashPolygonSet(polygons);
+        std::shared_ptr<Triangulation> triangulation = triangulationCache.get(key);
+        if(!triangulation) {
+            triangulation = std::make_shared<Triangulation>(previousTriangulation->update(polygons, triangulationWorkerCount));
+            triangulationCache.put(key, triangulation);
+        }
+        return wrapTriangulation(jni, triangulation);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    setWorkerCount
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_setWorkerCount
+        (JNIEnv* jni, jclass, jint workerCount) {
+    try {
+        if(workerCount < 0) throw std::invalid_argument("Worker count must not be negative");
+        triangulationWorkerCount = (unsigned int) workerCount;
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    setCacheMemoryBudget
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_setCacheMemoryBudget
+        (JNIEnv* jni, jclass, jlong bytes) {
+    try {
+        if(bytes < 0) throw std::invalid_argument("Cache memory budget must not be negative");
+        triangulationCache.setMemoryBudget((size_t) bytes);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    getCacheStatistics
+ * Signature: ()Lyaaz/decomposition/viewer/polygon/Triangulation$CacheStatistics;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_getCacheStatistics
+        (JNIEnv* jni, jclass) {
+    try {
+        TriangulationCache::Statistics statistics = triangulationCache.getStatistics();
+        return jni->NewObject(JClass->CacheStatistics, JClass->CacheStatistics.init,
+                              (jlong) statistics.hits, (jlong) statistics.misses, (jlong) statistics.evictions,
+                              (jlong) statistics.entries, (jlong) statistics.memoryUsage, (jlong) statistics.memoryBudget);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    setTraceFile
+ * Signature: (Ljava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_setTraceFile
+        (JNIEnv* jni, jclass, jstring path) {
+    try {
+        if(path == nullptr) {
+            TriangulationTrace::close();
+            return;
+        }
+        const char* chars = jni->GetStringUTFChars(path, nullptr);
+        std::string file = chars;
+        jni->ReleaseStringUTFChars(path, chars);
+        TriangulationTrace::open(file);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    getStatistics
+ * Signature: ()Lyaaz/decomposition/viewer/polygon/Triangulation$Statistics;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_getStatistics
+        (JNIEnv* jni, jobject javaTriangulationObject) {
+    try {
+        // Every stage has its name, milliseconds, heap growth in bytes and element count. Heap growth is not a peak:
+        // it's sampled for the whole process when the stage ends, -1 if allocator doesn't report it, see TriangulationStatistics
+        const TriangulationStatistics& statistics = unwrapTriangulation(jni, javaTriangulationObject)->statistics;
+        jobjectArray stages = jni->NewObjectArray(TriangulationStatistics::STAGE_COUNT, JClass->StageStatistics, nullptr);
+        for(jsize i = 0; i < TriangulationStatistics::STAGE_COUNT; i++) {
+            const TriangulationStatistics::Stage& stage = statistics.stages[i];
+            jstring name = jni->NewStringUTF(TriangulationStatistics::STAGE_NAMES[i]);
+            jobject javaStage = jni->NewObject(JClass->StageStatistics, JClass->StageStatistics.init, name, (jdouble) stage.milliseconds,
+                                               (jlong) stage.heapGrowthBytes, (jlong) stage.elements);
+            jni->SetObjectArrayElement(stages, i, javaStage);
+            jni->DeleteLocalRef(javaStage);
+            jni->DeleteLocalRef(name);
+        }
+        return jni->NewObject(JClass->TriangulationStatistics, JClass->TriangulationStatistics.init, (jdouble) statistics.totalMilliseconds,
+                              (jlong) statistics.polygons, (jlong) statistics.groups, (jlong) statistics.reusedGroups,
+                              (jlong) statistics.inputVertices, (jlong) statistics.steinerVertices, (jlong) statistics.treeNodes,
+                              (jlong) statistics.triangles, stages);
     } catch(std::exception& e) {
         rethrowNativeException(jni, e);
         return nullptr;
@@ -177,7 +658,7 @@ JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_c
 JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_destroy
         (JNIEnv* jni, jclass, jlong address) {
     try {
-        auto triangulation = (Triangulation*) address;
+        auto triangulation = (std::shared_ptr<Triangulation>*) address;
         delete triangulation;
     } catch(std::exception& e) {
         rethrowNativeException(jni, e);
@@ -214,11 +695,16 @@ JNIEXPORT jobjectArray JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulat
 JNIEXPORT jobjectArray JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_getDecomposedPolygons
         (JNIEnv* jni, jobject javaTriangulationObject) {
     try {
-        Triangulation* triangulation = unwrapTriangulation(jni, javaTriangulationObject);
-        jobjectArray resultPolygons = jni->NewObjectArray(countPolygonsInTree(triangulation->polygonTree), JClass->DecomposedPolygon, nullptr);
-        int addedPolygons = 0;
-        for (const decomposition::PolygonTree& polygon : triangulation->polygonTree) {
-            addSubtreeOfDebugPolygonsToJavaArray(jni, polygon, resultPolygons, addedPolygons);
+        const FlatPolygonTree& polygonTree = unwrapTriangulation(jni, javaTriangulationObject)->polygonTree;
+        jobjectArray resultPolygons = jni->NewObjectArray((jsize) polygonTree.size(), JClass->DecomposedPolygon, nullptr);
+        for (size_t i = 0; i < polygonTree.size(); i++) {
+            const FlatPolygonTree::Node& node = polygonTree.nodes[i];
+            jintArray vertexIndices = jni->NewIntArray((jsize) node.indexCount);
+            jni->SetIntArrayRegion(vertexIndices, 0, (jsize) node.indexCount, (const jint*) polygonTree.getVertexIndices(node));
+            jobject javaPolygon = jni->NewObject(JClass->DecomposedPolygon, JClass->DecomposedPolygon.init, (jint) node.netWinding, vertexIndices);
+            jni->SetObjectArrayElement(resultPolygons, (jsize) i, javaPolygon);
+            jni->DeleteLocalRef(javaPolygon);
+            jni->DeleteLocalRef(vertexIndices);
         }
         return resultPolygons;
     } catch(std::exception& e) {
@@ -251,6 +737,125 @@ JNIEXPORT jobjectArray JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulat
 
 
 
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    getVertexBuffer
+ * Signature: ()Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_getVertexBuffer
+        (JNIEnv* jni, jobject javaTriangulationObject) {
+    try {
+        Triangulation* triangulation = unwrapTriangulation(jni, javaTriangulationObject);
+        return wrapNativeMemory(jni, triangulation->vertices.data(), triangulation->vertices.size() * sizeof(glm::dvec2));
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    getTriangleBuffer
+ * Signature: ()Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_getTriangleBuffer
+        (JNIEnv* jni, jobject javaTriangulationObject) {
+    try {
+        Triangulation* triangulation = unwrapTriangulation(jni, javaTriangulationObject);
+        return wrapNativeMemory(jni, triangulation->triangles.data(), triangulation->triangles.size() * sizeof(glm::ivec3));
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_Triangulation
+ * Method:    getPolygonTreeBuffer
+ * Signature: ()Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_polygon_Triangulation_getPolygonTreeBuffer
+        (JNIEnv* jni, jobject javaTriangulationObject) {
+    try {
+        Triangulation* triangulation = unwrapTriangulation(jni, javaTriangulationObject);
+        const std::vector<int>& polygonTree = triangulation->getSerializedPolygonTree();
+        return wrapNativeMemory(jni, polygonTree.data(), polygonTree.size() * sizeof(int));
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+
+
+
+
+
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_TriangulationJob
+ * Method:    destroy
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_polygon_TriangulationJob_destroy
+        (JNIEnv* jni, jclass, jlong address) {
+    try {
+        auto job = (TriangulationJob*) address;
+        delete job;
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_TriangulationJob
+ * Method:    cancel
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_polygon_TriangulationJob_cancel
+        (JNIEnv* jni, jobject javaTriangulationJobObject) {
+    try {
+        unwrapTriangulationJob(jni, javaTriangulationJobObject)->cancel();
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_TriangulationJob
+ * Method:    getStage
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_yaaz_decomposition_viewer_polygon_TriangulationJob_getStage
+        (JNIEnv* jni, jobject javaTriangulationJobObject) {
+    try {
+        return (jint) unwrapTriangulationJob(jni, javaTriangulationJobObject)->progress.stage;
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return 0;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_polygon_TriangulationJob
+ * Method:    getStageProgress
+ * Signature: ()D
+ */
+JNIEXPORT jdouble JNICALL Java_yaaz_decomposition_viewer_polygon_TriangulationJob_getStageProgress
+        (JNIEnv* jni, jobject javaTriangulationJobObject) {
+    try {
+        const TriangulationProgress& progress = unwrapTriangulationJob(jni, javaTriangulationJobObject)->progress;
+        if(progress.stage == TriangulationProgress::DONE) return 1;
+        if(progress.stage != TriangulationProgress::TRIANGULATION || progress.totalPolygons == 0) return 0;
+        return (jdouble) progress.triangulatedPolygons / (jdouble) progress.totalPolygons;
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return 0;
+    }
+}
+
+
+
 
 
 /*
@@ -278,6 +883,7 @@ JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_d
         (JNIEnv* jni, jclass, jlong address) {
     try {
         auto vulkanRenderer = (JAWTVulkanRenderer*) address;
+        if(vulkanRenderer->polygonSet.source != nullptr) jni->DeleteWeakGlobalRef(vulkanRenderer->polygonSet.source);
         destroyVulkanRenderer(vulkanRenderer);
     } catch(std::exception& e) {
         rethrowNativeException(jni, e);
@@ -292,15 +898,274 @@ JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_d
 JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_paint
         (JNIEnv* jni, jobject javaVulkanRenderer, jdouble scaleX, jdouble scaleY) {
     try {
-        std::vector<std::vector<glm::dvec2>> polygonSet = convertJavaPolygonSet(jni,
+        JAWTVulkanRenderer* vulkanRenderer = unwrapVulkanRenderer(jni, javaVulkanRenderer);
+        updateBoundPolygonSet(jni, vulkanRenderer->polygonSet,
+                jni->GetObjectField(javaVulkanRenderer, JClass->VulkanRenderer.polygonSet));
+        Triangulation* triangulation =
+                unwrapTriangulation(jni, jni->GetObjectField(javaVulkanRenderer, JClass->VulkanRenderer.triangulation));
+        vulkanRenderer->render(jni, javaVulkanRenderer, triangulation, {scaleX, scaleY}, {0, 0});
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_VulkanRenderer
+ * Method:    paintView
+ * Signature: (DDDD)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_paintView
+        (JNIEnv* jni, jobject javaVulkanRenderer, jdouble scaleX, jdouble scaleY, jdouble offsetX, jdouble offsetY) {
+    try {
+        JAWTVulkanRenderer* vulkanRenderer = unwrapVulkanRenderer(jni, javaVulkanRenderer);
+        updateBoundPolygonSet(jni, vulkanRenderer->polygonSet,
                 jni->GetObjectField(javaVulkanRenderer, JClass->VulkanRenderer.polygonSet));
         Triangulation* triangulation =
                 unwrapTriangulation(jni, jni->GetObjectField(javaVulkanRenderer, JClass->VulkanRenderer.triangulation));
-        unwrapVulkanRenderer(jni, javaVulkanRenderer)->render(jni, javaVulkanRenderer, polygonSet, triangulation, {scaleX, scaleY});
+        vulkanRenderer->render(jni, javaVulkanRenderer, triangulation, {scaleX, scaleY}, {offsetX, offsetY});
     } catch(std::exception& e) {
         rethrowNativeException(jni, e);
     }
 }
 
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_VulkanRenderer
+ * Method:    setProfilingEnabled
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_setProfilingEnabled
+        (JNIEnv* jni, jobject javaVulkanRenderer, jboolean enabled) {
+    try {
+        unwrapVulkanRenderer(jni, javaVulkanRenderer)->setProfiling(enabled == JNI_TRUE);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_VulkanRenderer
+ * Method:    setAntialiasing
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_setAntialiasing
+        (JNIEnv* jni, jobject javaVulkanRenderer, jint mode) {
+    try {
+        // Mode is ordinal of off, 4x, 8x, max or automatic
+        unwrapVulkanRenderer(jni, javaVulkanRenderer)->setAntialiasing(mode);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_VulkanRenderer
+ * Method:    setFramesInFlight
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_setFramesInFlight
+        (JNIEnv* jni, jobject javaVulkanRenderer, jint count) {
+    try {
+        unwrapVulkanRenderer(jni, javaVulkanRenderer)->setFramesInFlight(count);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_VulkanRenderer
+ * Method:    bindCommandBuffers
+ * Signature: (Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_bindCommandBuffers
+        (JNIEnv* jni, jobject javaVulkanRenderer, jobject commandBuffer, jobject resultBuffer) {
+    try {
+        JAWTVulkanRenderer* vulkanRenderer = unwrapVulkanRenderer(jni, javaVulkanRenderer);
+        vulkanRenderer->commandChannel.reset();
+        vulkanRenderer->commandTriangulation.reset();
+        if(commandBuffer == nullptr || resultBuffer == nullptr) return;
+        // Java keeps both direct buffers referenced while they are bound, so their addresses stay valid
+        vulkanRenderer->commandChannel = std::make_unique<CommandChannel>(
+                SharedRing(jni->GetDirectBufferAddress(commandBuffer), jni->GetDirectBufferCapacity(commandBuffer)),
+                SharedRing(jni->GetDirectBufferAddress(resultBuffer), jni->GetDirectBufferCapacity(resultBuffer)));
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_VulkanRenderer
+ * Method:    flushCommands
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_flushCommands
+        (JNIEnv* jni, jobject javaVulkanRenderer) {
+    try {
+        JAWTVulkanRenderer* vulkanRenderer = unwrapVulkanRenderer(jni, javaVulkanRenderer);
+        if(!vulkanRenderer->commandChannel) throw std::runtime_error("Command buffers are not bound");
+        RendererCommandHandler handler(jni, javaVulkanRenderer, *vulkanRenderer);
+        return (jint) vulkanRenderer->commandChannel->flush(vulkanRenderer->polygonSet.polygons, handler);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return 0;
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_VulkanRenderer
+ * Method:    getStatistics
+ * Signature: ()Lyaaz/decomposition/viewer/rendering/VulkanRenderer$Statistics;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_getStatistics
+        (JNIEnv* jni, jobject javaVulkanRenderer) {
+    try {
+        // Averages over last frames. Passes carry their names, so Java doesn't depend on their order
+        FrameStatistics statistics = unwrapVulkanRenderer(jni, javaVulkanRenderer)->getStatistics();
+        jobjectArray passes = jni->NewObjectArray(FrameStatistics::PASS_COUNT, JClass->PassStatistics, nullptr);
+        for(jsize i = 0; i < FrameStatistics::PASS_COUNT; i++) {
+            const FrameStatistics::PassStatistics& pass = statistics.passes[i];
+            jstring name = jni->NewStringUTF(FrameStatistics::PASS_NAMES[i]);
+            jobject javaPass = jni->NewObject(JClass->PassStatistics, JClass->PassStatistics.init, name, (jdouble) pass.gpuMilliseconds,
+                                              (jdouble) pass.primitives, (jdouble) pass.vertexInvocations,
+                                              (jdouble) pass.fragmentInvocations, (jdouble) pass.computeInvocations);
+            jni->SetObjectArrayElement(passes, i, javaPass);
+            jni->DeleteLocalRef(javaPass);
+            jni->DeleteLocalRef(name);
+        }
+        return jni->NewObject(JClass->RendererStatistics, JClass->RendererStatistics.init, passes,
+                              (jdouble) statistics.uploadMilliseconds, (jdouble) statistics.presentMilliseconds);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
+}
+
+
+
+
 
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_OffscreenRenderer
+ * Method:    create
+ * Signature: (II)Lyaaz/decomposition/viewer/rendering/OffscreenRenderer;
+ */
+JNIEXPORT jobject JNICALL Java_yaaz_decomposition_viewer_rendering_OffscreenRenderer_create
+        (JNIEnv* jni, jclass, jint width, jint height) {
+    try {
+        if(width <= 0 || height <= 0) throw std::invalid_argument("Image size must be positive");
+        auto offscreenRenderer = createOffscreenVulkanRenderer((uint32_t) width, (uint32_t) height);
+        return jni->NewObject(JClass->OffscreenRenderer, JClass->OffscreenRenderer.init, (jlong) offscreenRenderer);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+        return nullptr;
+    }
 }
+
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_OffscreenRenderer
+ * Method:    destroy
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_OffscreenRenderer_destroy
+        (JNIEnv* jni, jclass, jlong address) {
+    try {
+        destroyOffscreenVulkanRenderer((OffscreenVulkanRenderer*) address);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+/*
+ * Class:     yaaz_decomposition_viewer_rendering_OffscreenRenderer
+ * Method:    render
+ * Signature: ([Lyaaz/decomposition/viewer/polygon/PolygonSet;[Lyaaz/decomposition/viewer/polygon/Triangulation;DDDDLjava/nio/ByteBuffer;)V
+ */
+JNIEXPORT void JNICALL Java_yaaz_decomposition_viewer_rendering_OffscreenRenderer_render
+        (JNIEnv* jni, jobject javaOffscreenRenderer, jobjectArray javaPolygonSets, jobjectArray javaTriangulations,
+         jdouble scaleX, jdouble scaleY, jdouble offsetX, jdouble offsetY, jobject pixelBuffer) {
+    try {
+        OffscreenVulkanRenderer* offscreenRenderer = unwrapOffscreenRenderer(jni, javaOffscreenRenderer);
+        jsize count = jni->GetArrayLength(javaPolygonSets);
+        jsize triangulationCount = javaTriangulations == nullptr ? 0 : jni->GetArrayLength(javaTriangulations);
+        std::vector<std::vector<std::vector<glm::dvec2>>> polygonSets(count);
+        std::vector<const Triangulation*> triangulations(count, nullptr);
+        for(jsize i = 0; i < count; i++) {
+            jobject javaPolygonSet = jni->GetObjectArrayElement(javaPolygonSets, i);
+            if(javaPolygonSet != nullptr) polygonSets[i] = convertJavaPolygonSet(jni, javaPolygonSet);
+            jni->DeleteLocalRef(javaPolygonSet);
+            if(i < triangulationCount) {
+                jobject javaTriangulation = jni->GetObjectArrayElement(javaTriangulations, i);
+                triangulations[i] = unwrapTriangulation(jni, javaTriangulation);
+                jni->DeleteLocalRef(javaTriangulation);
+            }
+        }
+
+        auto pixels = (uint8_t*) jni->GetDirectBufferAddress(pixelBuffer);
+        if(pixels == nullptr) throw std::invalid_argument("Pixel buffer must be direct");
+        jlong requiredCapacity = (jlong) count * offscreenRenderer->getWidth() * offscreenRenderer->getHeight() * 4;
+        if(jni->GetDirectBufferCapacity(pixelBuffer) < requiredCapacity) throw std::invalid_argument("Pixel buffer is too small");
+        offscreenRenderer->render(polygonSets, triangulations, {scaleX, scaleY}, {offsetX, offsetY}, pixels);
+    } catch(std::exception& e) {
+        rethrowNativeException(jni, e);
+    }
+}
+
+
+}
+
+
+/** Binds native methods explicitly, so that JVM doesn't look up exported symbols on the first call of every method.
+ * Signatures of nested classes use $ here, unlike in the comments above.
+ */
+static void registerNatives(JNIEnv* jni) {
+    auto method = [](const char* name, const char* signature, void* function) {
+        return JNINativeMethod {(char*) name, (char*) signature, function};
+    };
+    auto registerClass = [jni](jclass javaClass, const std::vector<JNINativeMethod>& methods) {
+        if(jni->RegisterNatives(javaClass, methods.data(), (jint) methods.size()) != JNI_OK)
+            throw std::runtime_error("Cannot register native methods");
+    };
+    registerClass(JClass->Triangulation, {
+            method("create", "(Lyaaz/decomposition/viewer/polygon/PolygonSet;)Lyaaz/decomposition/viewer/polygon/Triangulation;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_create),
+            method("createAsync", "(Lyaaz/decomposition/viewer/polygon/PolygonSet;Lyaaz/decomposition/viewer/polygon/TriangulationJob$Callback;)Lyaaz/decomposition/viewer/polygon/TriangulationJob;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_createAsync),
+            method("createFromArrays", "([D[I)Lyaaz/decomposition/viewer/polygon/Triangulation;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_createFromArrays),
+            method("createFromBuffer", "(Ljava/nio/DoubleBuffer;[I)Lyaaz/decomposition/viewer/polygon/Triangulation;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_createFromBuffer),
+            method("benchmarkIngestion", "(Lyaaz/decomposition/viewer/polygon/PolygonSet;I)Ljava/lang/String;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_benchmarkIngestion),
+            method("update", "(Lyaaz/decomposition/viewer/polygon/PolygonSet;)Lyaaz/decomposition/viewer/polygon/Triangulation;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_update),
+            method("setWorkerCount", "(I)V", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_setWorkerCount),
+            method("setCacheMemoryBudget", "(J)V", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_setCacheMemoryBudget),
+            method("getCacheStatistics", "()Lyaaz/decomposition/viewer/polygon/Triangulation$CacheStatistics;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_getCacheStatistics),
+            method("setTraceFile", "(Ljava/lang/String;)V", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_setTraceFile),
+            method("getStatistics", "()Lyaaz/decomposition/viewer/polygon/Triangulation$Statistics;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_getStatistics),
+            method("destroy", "(J)V", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_destroy),
+            method("getAllVertices", "()[Ljava/awt/geom/Point2D;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_getAllVertices),
+            method("getDecomposedPolygons", "()[Lyaaz/decomposition/viewer/polygon/Triangulation$DecomposedPolygon;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_getDecomposedPolygons),
+            method("getTriangles", "()[Lyaaz/decomposition/viewer/polygon/Triangulation$Triangle;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_getTriangles),
+            method("getVertexBuffer", "()Ljava/nio/ByteBuffer;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_getVertexBuffer),
+            method("getTriangleBuffer", "()Ljava/nio/ByteBuffer;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_getTriangleBuffer),
+            method("getPolygonTreeBuffer", "()Ljava/nio/ByteBuffer;", (void*) &Java_yaaz_decomposition_viewer_polygon_Triangulation_getPolygonTreeBuffer)
+    });
+    registerClass(JClass->TriangulationJob, {
+            method("destroy", "(J)V", (void*) &Java_yaaz_decomposition_viewer_polygon_TriangulationJob_destroy),
+            method("cancel", "()V", (void*) &Java_yaaz_decomposition_viewer_polygon_TriangulationJob_cancel),
+            method("getStage", "()I", (void*) &Java_yaaz_decomposition_viewer_polygon_TriangulationJob_getStage),
+            method("getStageProgress", "()D", (void*) &Java_yaaz_decomposition_viewer_polygon_TriangulationJob_getStageProgress)
+    });
+    registerClass(JClass->VulkanRenderer, {
+            method("create", "()Lyaaz/decomposition/viewer/rendering/VulkanRenderer;", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_create),
+            method("destroy", "(J)V", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_destroy),
+            method("paint", "(DD)V", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_paint),
+            method("paintView", "(DDDD)V", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_paintView),
+            method("setProfilingEnabled", "(Z)V", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_setProfilingEnabled),
+            method("setAntialiasing", "(I)V", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_setAntialiasing),
+            method("setFramesInFlight", "(I)V", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_setFramesInFlight),
+            method("bindCommandBuffers", "(Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;)V", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_bindCommandBuffers),
+            method("flushCommands", "()I", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_flushCommands),
+            method("getStatistics", "()Lyaaz/decomposition/viewer/rendering/VulkanRenderer$Statistics;", (void*) &Java_yaaz_decomposition_viewer_rendering_VulkanRenderer_getStatistics)
+    });
+    registerClass(JClass->OffscreenRenderer, {
+            method("create", "(II)Lyaaz/decomposition/viewer/rendering/OffscreenRenderer;", (void*) &Java_yaaz_decomposition_viewer_rendering_OffscreenRenderer_create),
+            method("destroy", "(J)V", (void*) &Java_yaaz_decomposition_viewer_rendering_OffscreenRenderer_destroy),
+            method("render", "([Lyaaz/decomposition/viewer/polygon/PolygonSet;[Lyaaz/decomposition/viewer/polygon/Triangulation;DDDDLjava/nio/ByteBuffer;)V", (void*) &Java_yaaz_decomposition_viewer_rendering_OffscreenRenderer_render)
+    });
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+/** Returns worker count to use, 0 means number of hardware threads. */
+static inline unsigned int resolveWorkerCount(unsigned int workerCount) {
+    if(workerCount != 0) return workerCount;
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads == 0 ? 1 : hardwareThreads;
+}
+
+
+
+/** Persistent threads shared by all parallel loops of the process, so that loops don't create and join threads on every call.
+ * Tasks are run in submission order by whichever thread is free.
+ */
+class ThreadPool {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping {false};
+
+public:
+    explicit ThreadPool(unsigned int threadCount) {
+        threads.reserve(threadCount);
+        for (unsigned int i = 0; i < threadCount; i++) {
+            threads.emplace_back([this]() {
+                for(;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                        if(tasks.empty()) return;
+                        task = std::move(tasks.front());
+                        tasks.pop_front();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** Runs remaining tasks and joins all threads */
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for(std::thread& thread : threads) thread.join();
+    }
+
+    [[nodiscard]] size_t size() const {
+        return threads.size();
+    }
+
+    /** Task must not throw */
+    void submit(std::function<void()>&& task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        condition.notify_one();
+    }
+
+    /** Pool of one thread per hardware thread, created on first use */
+    static ThreadPool& getShared() {
+        static ThreadPool pool(resolveWorkerCount(0));
+        return pool;
+    }
+};
+
+
+
+/** Calls task(i) for every i in [0, count) using up to workerCount threads, calling thread included,
+ * others are taken from shared thread pool, so at most one more than there are hardware threads.
+ * Indices are handed out dynamically one by one, so uneven tasks are balanced between workers.
+ * If any task throws, remaining indices are skipped and first exception is rethrown after all workers finished.
+ * Pool workers, which didn't start before the calling thread ran out of indices, are not waited for, so loops may nest.
+ */
+template <typename Task>
+static void parallelFor(size_t count, unsigned int workerCount, Task&& task) {
+    workerCount = resolveWorkerCount(workerCount);
+    if(workerCount > count) workerCount = (unsigned int) count;
+    if(workerCount <= 1) {
+        for (size_t i = 0; i < count; i++) task(i);
+        return;
+    }
+
+    std::atomic<size_t> nextIndex {0};
+    std::atomic<bool> failed {false};
+    std::exception_ptr exception;
+    std::mutex exceptionMutex;
+    auto worker = [&]() {
+        try {
+            for (size_t i = nextIndex++; i < count && !failed; i = nextIndex++) task(i);
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(exceptionMutex);
+            if(!exception) exception = std::current_exception();
+            failed = true;
+        }
+    };
+
+    // Outlives this call, as pool may start helpers after the loop is over, these return right away
+    struct Helpers {
+        std::mutex mutex;
+        std::condition_variable condition;
+        unsigned int running {0};
+        bool closed {false};
+    };
+    auto helpers = std::make_shared<Helpers>();
+    ThreadPool& pool = ThreadPool::getShared();
+    auto helperCount = (unsigned int) std::min<size_t>(workerCount - 1, pool.size());
+    for (unsigned int i = 0; i < helperCount; i++) {
+        pool.submit([helpers, &worker]() {
+            {
+                std::lock_guard<std::mutex> lock(helpers->mutex);
+                if(helpers->closed) return;
+                helpers->running++;
+            }
+            worker();
+            {
+                std::lock_guard<std::mutex> lock(helpers->mutex);
+                helpers->running--;
+            }
+            helpers->condition.notify_all();
+        });
+    }
+    worker();
+    {
+        std::unique_lock<std::mutex> lock(helpers->mutex);
+        helpers->closed = true;
+        helpers->condition.wait(lock, [&]() { return helpers->running == 0; });
+    }
+    if(exception) std::rethrow_exception(exception);
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm.hpp>
+
+
+
+static inline uint64_t mixHash(uint64_t hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+static inline uint64_t combineHash(uint64_t hash, uint64_t value) {
+    return mixHash(hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2)));
+}
+
+
+
+/** Content hash of polygon, equal polygons have equal hashes (bitwise equality of coordinates). */
+static uint64_t hashPolygon(const std::vector<glm::dvec2>& polygon) {
+    uint64_t hash = mixHash(polygon.size());
+    for(const glm::dvec2& vertex : polygon) {
+        uint64_t x, y;
+        std::memcpy(&x, &vertex.x, sizeof(double));
+        std::memcpy(&y, &vertex.y, sizeof(double));
+        hash = combineHash(combineHash(hash, x), y);
+    }
+    return hash;
+}
+
+
+
+struct Hash128 {
+    uint64_t low, high;
+
+    bool operator==(const Hash128& other) const {
+        return low == other.low && high == other.high;
+    }
+
+    struct Hasher {
+        size_t operator()(const Hash128& hash) const {
+            return (size_t) hash.low;
+        }
+    };
+};
+
+
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+
+
+/** Content hash of whole polygon set, covering both coordinates and polygon boundaries.
+ * Two lanes are updated independently and mixed together at the end, giving 128-bit result.
+ */
+static Hash128 hashPolygonSet(const std::vector<std::vector<glm::dvec2>>& polygons) {
+    uint64_t low = 0x243f6a8885a308d3ULL, high = 0x13198a2e03707344ULL;
+    auto add = [&](uint64_t value) {
+        low = rotateLeft(low ^ value, 29) * 0x9e3779b97f4a7c15ULL;
+        high = rotateLeft(high + value, 37) * 0xc2b2ae3d27d4eb4fULL;
+    };
+    add(polygons.size());
+    for(const std::vector<glm::dvec2>& polygon : polygons) {
+        add(polygon.size());
+        for(const glm::dvec2& vertex : polygon) {
+            uint64_t x, y;
+            std::memcpy(&x, &vertex.x, sizeof(double));
+            std::memcpy(&y, &vertex.y, sizeof(double));
+            add(x);
+            add(y);
+        }
+    }
+    uint64_t mixedLow = mixHash(low ^ rotateLeft(high, 32)), mixedHigh = mixHash(high ^ mixedLow);
+    return {mixedLow, mixedHigh};
+}
\ No newline at end of file
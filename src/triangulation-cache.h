@@ -0,0 +1,80 @@
+#pragma once
+
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "triangulation.h"
+
+
+
+/** LRU cache of triangulations keyed by content hash of their polygon sets, bounded by estimated memory usage.
+ * Cached triangulations are shared with their users, so evicting entry only drops reference held by the cache.
+ */
+class TriangulationCache {
+
+    struct Entry {
+        Hash128 key;
+        std::shared_ptr<Triangulation> triangulation;
+        size_t memoryUsage;
+    };
+
+    std::mutex mutex;
+    std::list<Entry> entries; // Most recently used first
+    std::unordered_map<Hash128, std::list<Entry>::iterator, Hash128::Hasher> index;
+    size_t memoryBudget, memoryUsage {0};
+    uint64_t hits {0}, misses {0}, evictions {0};
+
+    void evict(size_t budget) {
+        while(memoryUsage > budget && !entries.empty()) {
+            memoryUsage -= entries.back().memoryUsage;
+            index.erase(entries.back().key);
+            entries.pop_back();
+            evictions++;
+        }
+    }
+
+public:
+    struct Statistics {
+        uint64_t hits, misses, evictions;
+        size_t entries, memoryUsage, memoryBudget;
+    };
+
+    explicit TriangulationCache(size_t memoryBudget) : memoryBudget(memoryBudget) {}
+
+    std::shared_ptr<Triangulation> get(const Hash128& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if(it == index.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->triangulation;
+    }
+
+    void put(const Hash128& key, const std::shared_ptr<Triangulation>& triangulation) {
+        size_t triangulationMemoryUsage = triangulation->getMemoryUsage();
+        std::lock_guard<std::mutex> lock(mutex);
+        if(index.find(key) != index.end() || triangulationMemoryUsage > memoryBudget) return;
+        evict(memoryBudget - triangulationMemoryUsage);
+        entries.push_front({key, triangulation, triangulationMemoryUsage});
+        index.emplace(key, entries.begin());
+        memoryUsage += triangulationMemoryUsage;
+    }
+
+    void setMemoryBudget(size_t budget) {
+        std::lock_guard<std::mutex> lock(mutex);
+        memoryBudget = budget;
+        evict(memoryBudget);
+    }
+
+    Statistics getStatistics() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return {hits, misses, evictions, entries.size(), memoryUsage, memoryBudget};
+    }
+
+};
\ No newline at end of file
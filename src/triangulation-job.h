@@ -0,0 +1,53 @@
+#pragma once
+
+
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "triangulation.h"
+
+
+
+/** Runs triangulation on its own thread. Completion callback is called on that thread with either
+ * resulting triangulation, or nullptr and error (nullptr if job was cancelled).
+ */
+class TriangulationJob {
+public:
+    using Factory = std::function<std::shared_ptr<Triangulation>(TriangulationProgress& progress)>;
+    using Callback = std::function<void(std::shared_ptr<Triangulation> triangulation, const std::exception* error)>;
+
+    TriangulationProgress progress;
+
+private:
+    std::thread thread;
+
+public:
+    TriangulationJob(Factory&& createTriangulation, Callback&& onComplete) :
+    thread([this, createTriangulation = std::move(createTriangulation), onComplete = std::move(onComplete)]() {
+        std::shared_ptr<Triangulation> triangulation;
+        try {
+            triangulation = createTriangulation(progress);
+        } catch(const TriangulationCancelledException&) {
+            onComplete(nullptr, nullptr);
+            return;
+        } catch(const std::exception& e) {
+            onComplete(nullptr, &e);
+            return;
+        }
+        onComplete(std::move(triangulation), nullptr);
+    }) {}
+    TriangulationJob(const TriangulationJob&) = delete;
+    TriangulationJob& operator=(const TriangulationJob&) = delete;
+
+    void cancel() {
+        progress.cancelled = true;
+    }
+
+    /** Cancels job and waits for it to finish, unless destroyed from completion callback itself. */
+    ~TriangulationJob() {
+        cancel();
+        if(thread.get_id() == std::this_thread::get_id()) thread.detach();
+        else if(thread.joinable()) thread.join();
+    }
+};
\ No newline at end of file
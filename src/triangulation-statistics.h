@@ -0,0 +1,181 @@
+#pragma once
+
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+
+
+/** Bytes currently allocated from heap by the whole process, or -1 when allocator doesn't report it. */
+static inline int64_t getHeapAllocatedBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return (int64_t) (info.uordblks + info.hblkhd);
+#elif defined(__APPLE__)
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(nullptr, &statistics);
+    return (int64_t) statistics.size_in_use;
+#else
+    return -1;
+#endif
+}
+
+
+
+/** What one triangulation spent in every stage. Heap usage is sampled at stage boundaries only and covers the whole process,
+ * so allocations freed within a stage and concurrent triangulations are not told apart. It still shows which stage holds memory.
+ */
+struct TriangulationStatistics {
+
+    static constexpr size_t STAGE_COUNT = 5;
+    static constexpr const char* STAGE_NAMES[STAGE_COUNT] {
+            "Steiner vertices", "Graph decomposition", "Polygon trees", "Polygon area trees", "Triangulation"
+    };
+
+    struct Stage {
+        double startMilliseconds {0}, milliseconds {0};
+        /** Heap growth since start of triangulation, sampled when the stage ends, -1 if not available */
+        int64_t heapGrowthBytes {-1};
+        /** Steiner vertices added, groups decomposed, tree nodes, area tree roots and triangles respectively */
+        uint64_t elements {0};
+    };
+
+    std::array<Stage, STAGE_COUNT> stages {};
+    /** Steady clock time of start, so that traces of different triangulations line up */
+    int64_t startMicroseconds {0};
+    double totalMilliseconds {0};
+    uint64_t polygons {0}, groups {0}, reusedGroups {0}, inputVertices {0}, steinerVertices {0}, treeNodes {0}, triangles {0};
+
+
+    void begin() {
+        startTime = std::chrono::steady_clock::now();
+        startMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(startTime.time_since_epoch()).count();
+        baselineBytes = getHeapAllocatedBytes();
+    }
+
+    /** Ends current stage, if any, and starts the given one, or none if it's out of range */
+    void enterStage(size_t stage) {
+        auto now = std::chrono::steady_clock::now();
+        int64_t allocatedBytes = baselineBytes < 0 ? -1 : getHeapAllocatedBytes() - baselineBytes;
+        if(currentStage < STAGE_COUNT) {
+            Stage& current = stages[currentStage];
+            current.milliseconds = getMilliseconds(now) - current.startMilliseconds;
+            current.heapGrowthBytes = allocatedBytes;
+        }
+        currentStage = stage;
+        if(currentStage < STAGE_COUNT) stages[currentStage].startMilliseconds = getMilliseconds(now);
+    }
+
+    void end() {
+        enterStage(STAGE_COUNT);
+        totalMilliseconds = getMilliseconds(std::chrono::steady_clock::now());
+    }
+
+
+private:
+    std::chrono::steady_clock::time_point startTime;
+    int64_t baselineBytes {-1};
+    size_t currentStage {STAGE_COUNT};
+
+    [[nodiscard]] double getMilliseconds(std::chrono::steady_clock::time_point time) const {
+        return std::chrono::duration<double, std::milli>(time - startTime).count();
+    }
+};
+
+
+
+/** Appends every finished triangulation to Chrome trace event file, which can be opened in Perfetto or chrome://tracing.
+ * File is written in JSON array format, which viewers accept even without closing bracket, so trace of crashed process is still readable.
+ * Disabled unless enabled from Java or by DECOMPOSITION_VIEWER_TRACE_FILE environment variable.
+ */
+class TriangulationTrace {
+
+    static inline std::mutex mutex;
+    static inline std::ofstream file;
+    static inline bool firstEvent {true};
+    static inline std::atomic<bool> enabled {false};
+    static inline std::atomic<int> lastThreadId {0};
+
+
+    static int getThreadId() {
+        thread_local int threadId = ++lastThreadId;
+        return threadId;
+    }
+
+    static void writeEvent(const char* name, int threadId, int64_t startMicroseconds, double milliseconds, const std::string& arguments) {
+        file << (firstEvent ? "[\n" : ",\n") << R"({"name": ")" << name << R"(", "cat": "triangulation", "ph": "X", "pid": 1, "tid": )" <<
+             threadId << ", \"ts\": " << startMicroseconds << ", \"dur\": " << (int64_t) (milliseconds * 1000) <<
+             ", \"args\": {" << arguments << "}}";
+        firstEvent = false;
+    }
+
+    static void closeFile() {
+        if(!file.is_open()) return;
+        file << (firstEvent ? "[\n]" : "\n]") << std::endl;
+        file.close();
+    }
+
+
+public:
+    /** Starts new trace in given file, empty path stops tracing */
+    static void open(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        closeFile();
+        enabled = false;
+        if(path.empty()) return;
+        file.open(path, std::ios::trunc);
+        if(!file) throw std::runtime_error("Cannot open trace file " + path);
+        firstEvent = true;
+        enabled = true;
+    }
+
+    static void openFromEnvironment() {
+        if(const char* path = std::getenv("DECOMPOSITION_VIEWER_TRACE_FILE")) {
+            try {
+                open(path);
+            } catch(std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
+
+    static void close() {
+        open({});
+    }
+
+    static void record(const TriangulationStatistics& statistics) {
+        if(!enabled) return;
+        int threadId = getThreadId();
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!file.is_open()) return;
+        writeEvent("Triangulation", threadId, statistics.startMicroseconds, statistics.totalMilliseconds,
+                   "\"polygons\": " + std::to_string(statistics.polygons) +
+                   ", \"groups\": " + std::to_string(statistics.groups) +
+                   ", \"reusedGroups\": " + std::to_string(statistics.reusedGroups) +
+                   ", \"inputVertices\": " + std::to_string(statistics.inputVertices) +
+                   ", \"triangles\": " + std::to_string(statistics.triangles));
+        for (size_t i = 0; i < TriangulationStatistics::STAGE_COUNT; i++) {
+            const TriangulationStatistics::Stage& stage = statistics.stages[i];
+            writeEvent(TriangulationStatistics::STAGE_NAMES[i], threadId,
+                       statistics.startMicroseconds + (int64_t) (stage.startMilliseconds * 1000), stage.milliseconds,
+                       "\"elements\": " + std::to_string(stage.elements) +
+                       ", \"heapGrowthBytes\": " + std::to_string(stage.heapGrowthBytes));
+        }
+        file.flush();
+    }
+
+};
\ No newline at end of file
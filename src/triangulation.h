@@ -1,42 +1,419 @@
 #pragma once
 
 
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <unordered_map>
+
 #include "decomposition.h"
+#include "flat-polygon-tree.h"
+#include "parallel.h"
+#include "polygon-hash.h"
+#include "triangulation-statistics.h"
+#include "vertex-kernels.h"
+
+
+
+class TriangulationCancelledException : public std::exception {
+public:
+    [[nodiscard]] const char* what() const noexcept final {
+        return "Triangulation cancelled";
+    }
+};
+
+
+
+/** Shared between triangulating thread and observers, which can track current stage and cancel triangulation.
+ * Cancellation is checked between stages and between triangulations of separate polygons.
+ */
+struct TriangulationProgress {
+
+    enum Stage : int {
+        STEINER_VERTICES,
+        GRAPH_DECOMPOSITION,
+        POLYGON_TREES,
+        POLYGON_AREA_TREES,
+        TRIANGULATION,
+        DONE
+    };
+
+    std::atomic<int> stage {STEINER_VERTICES};
+    std::atomic<size_t> triangulatedPolygons {0}, totalPolygons {0};
+    std::atomic<bool> cancelled {false};
+
+    void checkCancelled() const {
+        if(cancelled) throw TriangulationCancelledException();
+    }
+
+    void enterStage(Stage newStage) {
+        checkCancelled();
+        stage = newStage;
+    }
+
+};
+
+
+
+static_assert(TriangulationStatistics::STAGE_COUNT == TriangulationProgress::DONE, "Statistics must have entry for every stage");
+
 
 
 struct Triangulation {
 
 
+    /** Polygons, which bounding boxes transitively overlap each other, cannot affect any other polygons,
+     * so each such group is triangulated on its own and can be reused by update if none of its polygons changed.
+     * Group vertices are its input vertices followed by its Steiner vertices, all indices inside group are local.
+     */
+    struct PolygonGroup {
+        std::vector<uint64_t> polygonHashes;
+        std::vector<size_t> polygonSizes;
+        size_t inputVertexCount {0};
+        std::vector<glm::dvec2> vertices;
+        FlatPolygonTree polygonTree;
+        std::vector<glm::ivec3> triangles;
+
+        [[nodiscard]] bool hasSameInput(const std::vector<std::vector<glm::dvec2>>& polygons,
+                                        const std::vector<size_t>& polygonIndices) const {
+            if(polygonIndices.size() != polygonSizes.size()) return false;
+            size_t vertex = 0;
+            for (size_t i = 0; i < polygonIndices.size(); i++) {
+                const std::vector<glm::dvec2>& polygon = polygons[polygonIndices[i]];
+                if(polygon.size() != polygonSizes[i]) return false;
+                if(!std::equal(polygon.begin(), polygon.end(), vertices.begin() + vertex)) return false;
+                vertex += polygon.size();
+            }
+            return true;
+        }
+    };
+
+
+    /** Unique identifier, which lets users detect that triangulation changed even if it was allocated at the same address. */
+    uint64_t id {nextId()};
+    /** Input vertices of all polygons in their original order, followed by Steiner vertices of every group. */
     std::vector<glm::dvec2> vertices;
-    std::vector<decomposition::PolygonTree> polygonTree;
+    FlatPolygonTree polygonTree;
     std::vector<glm::ivec3> triangles;
+    std::vector<int> serializedPolygonTree;
+    std::vector<std::shared_ptr<const PolygonGroup>> groups;
+    /** Time, heap usage and sizes of stages this triangulation went through, reused groups are not triangulated again. */
+    TriangulationStatistics statistics;
+
+
+    /** Groups and roots of polygon area trees are independent, so they are processed on workerCount threads
+     * (0 means number of hardware threads). Result is always the same as in serial mode.
+     * If progress is given, it is updated along the way and TriangulationCancelledException is thrown on cancellation.
+     */
+    explicit Triangulation(const std::vector<std::vector<glm::dvec2>>& polygons, unsigned int workerCount = 1,
+            TriangulationProgress* progress = nullptr) : Triangulation(polygons, workerCount, progress, nullptr) {}
+
+
+    /** Creates triangulation of new polygon set, reusing groups of this triangulation, which polygons didn't change.
+     * Only groups containing changed polygons or polygons overlapping them are triangulated again.
+     */
+    [[nodiscard]] Triangulation update(const std::vector<std::vector<glm::dvec2>>& polygons, unsigned int workerCount = 1,
+            TriangulationProgress* progress = nullptr) const {
+        return Triangulation(polygons, workerCount, progress, this);
+    }
 
 
-    explicit Triangulation(const std::vector<std::vector<glm::dvec2>>& polygons) {
-        std::vector<std::vector<int>> polygonVertexIndices;
+    /** Checks if vertices start with all vertices of given polygons, which is true for polygons this triangulation was built from. */
+    [[nodiscard]] bool hasInputVertices(const std::vector<std::vector<glm::dvec2>>& polygons) const {
+        size_t vertex = 0;
         for(const std::vector<glm::dvec2>& polygon : polygons) {
-            vertices.reserve(vertices.size() + polygon.size());
-            std::vector<int> indices;
-            for (auto i : polygon) {
-                indices.push_back(vertices.size());
-                vertices.push_back(i);
-            }
-            polygonVertexIndices.push_back(std::move(indices));
-        }
-        polygonTree = decomposition::buildPolygonTrees(vertices,
-                decomposition::decomposePolygonGraph(vertices,
-                        decomposition::insertSteinerVerticesForPolygons(vertices, polygonVertexIndices)
-                )
-        );
-        std::vector<decomposition::PolygonWithHolesTree> polygonWithHolesTree = decomposition::buildPolygonAreaTrees(
-                std::vector<decomposition::PolygonTree>(polygonTree)
-        );
+            if(vertex + polygon.size() > vertices.size()) return false;
+            if(!std::equal(polygon.begin(), polygon.end(), vertices.begin() + vertex)) return false;
+            vertex += polygon.size();
+        }
+        return true;
+    }
+
+
+    /** Estimated number of bytes owned by this triangulation, including its groups. */
+    [[nodiscard]] size_t getMemoryUsage() const {
+        size_t memoryUsage = sizeof(Triangulation) +
+                vertices.capacity() * sizeof(glm::dvec2) +
+                triangles.capacity() * sizeof(glm::ivec3) +
+                serializedPolygonTree.capacity() * sizeof(int) +
+                groups.capacity() * sizeof(std::shared_ptr<const PolygonGroup>) +
+                polygonTree.getMemoryUsage();
+        for(const std::shared_ptr<const PolygonGroup>& group : groups) {
+            memoryUsage += sizeof(PolygonGroup) +
+                    group->polygonHashes.capacity() * sizeof(uint64_t) +
+                    group->polygonSizes.capacity() * sizeof(size_t) +
+                    group->vertices.capacity() * sizeof(glm::dvec2) +
+                    group->triangles.capacity() * sizeof(glm::ivec3) +
+                    group->polygonTree.getMemoryUsage();
+        }
+        return memoryUsage;
+    }
+
+
+    /** Polygon tree in preorder, each node is stored as: netWinding, childrenCount, vertexCount, vertexIndices...
+     * Built with the triangulation, which may be shared between threads and handed out as direct buffer.
+     */
+    [[nodiscard]] const std::vector<int>& getSerializedPolygonTree() const {
+        return serializedPolygonTree;
+    }
+
+
+private:
+    using PolygonGraph = decltype(decomposition::insertSteinerVerticesForPolygons(
+            std::declval<std::vector<glm::dvec2>&>(), std::declval<std::vector<std::vector<int>>&>()));
+    using DecomposedPolygonGraph = decltype(decomposition::decomposePolygonGraph(
+            std::declval<std::vector<glm::dvec2>&>(), std::declval<PolygonGraph>()));
+
+
+    Triangulation(const std::vector<std::vector<glm::dvec2>>& polygons, unsigned int workerCount,
+            TriangulationProgress* progress, const Triangulation* previous) {
+        TriangulationProgress defaultProgress;
+        if(progress == nullptr) progress = &defaultProgress;
+        statistics.begin();
+
+        std::vector<std::vector<size_t>> groupPolygons = groupOverlappingPolygons(polygons);
+        std::vector<uint64_t> polygonHashes(polygons.size());
+        parallelFor(polygons.size(), workerCount, [&](size_t i) {
+            polygonHashes[i] = hashPolygon(polygons[i]);
+        });
+
+        std::unordered_multimap<uint64_t, std::shared_ptr<const PolygonGroup>> previousGroups;
+        if(previous != nullptr) {
+            for(const std::shared_ptr<const PolygonGroup>& group : previous->groups) {
+                previousGroups.emplace(hashGroup(group->polygonHashes), group);
+            }
+        }
+        groups.resize(groupPolygons.size());
+        std::vector<size_t> changedGroups;
+        for (size_t i = 0; i < groupPolygons.size(); i++) {
+            uint64_t groupHash = 0;
+            for(size_t polygon : groupPolygons[i]) groupHash = combineHash(groupHash, polygonHashes[polygon]);
+            auto [begin, end] = previousGroups.equal_range(groupHash);
+            for(auto it = begin; it != end; it++) {
+                if(it->second->hasSameInput(polygons, groupPolygons[i])) {
+                    groups[i] = it->second;
+                    break;
+                }
+            }
+            if(!groups[i]) changedGroups.push_back(i);
+        }
+
+        std::vector<std::shared_ptr<const PolygonGroup>> newGroups =
+                triangulateGroups(polygons, polygonHashes, groupPolygons, changedGroups, workerCount, *progress, statistics);
+        for (size_t i = 0; i < changedGroups.size(); i++) groups[changedGroups[i]] = std::move(newGroups[i]);
+
+        mergeGroups(polygons, groupPolygons, workerCount);
+        serializedPolygonTree = polygonTree.serialize();
+        statistics.end();
+        statistics.polygons = polygons.size();
+        statistics.groups = groups.size();
+        statistics.reusedGroups = groups.size() - changedGroups.size();
+        for(const std::vector<glm::dvec2>& polygon : polygons) statistics.inputVertices += polygon.size();
+        statistics.steinerVertices = vertices.size() - statistics.inputVertices;
+        statistics.treeNodes = polygonTree.size();
+        statistics.triangles = triangles.size();
+        TriangulationTrace::record(statistics);
+        progress->enterStage(TriangulationProgress::DONE);
+    }
+
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> lastId {0};
+        return ++lastId;
+    }
+
+
+    static uint64_t hashGroup(const std::vector<uint64_t>& polygonHashes) {
+        uint64_t hash = 0;
+        for(uint64_t polygonHash : polygonHashes) hash = combineHash(hash, polygonHash);
+        return hash;
+    }
+
+
+    /** Splits polygons into connected components of bounding box overlap graph, in order of their first polygon. */
+    static std::vector<std::vector<size_t>> groupOverlappingPolygons(const std::vector<std::vector<glm::dvec2>>& polygons) {
+        std::vector<glm::dvec2> minBounds(polygons.size()), maxBounds(polygons.size());
+        std::vector<size_t> sweepOrder;
+        for (size_t i = 0; i < polygons.size(); i++) {
+            if(polygons[i].empty()) continue;
+            getVertexKernels().computeBounds(polygons[i].data(), polygons[i].size(), minBounds[i], maxBounds[i]);
+            sweepOrder.push_back(i);
+        }
+        std::sort(sweepOrder.begin(), sweepOrder.end(), [&](size_t a, size_t b) { return minBounds[a].x < minBounds[b].x; });
+
+        std::vector<size_t> parent(polygons.size());
+        std::iota(parent.begin(), parent.end(), 0);
+        auto findRoot = [&](size_t i) {
+            while(parent[i] != i) i = parent[i] = parent[parent[i]];
+            return i;
+        };
+        for (size_t i = 0; i < sweepOrder.size(); i++) {
+            size_t a = sweepOrder[i];
+            for (size_t j = i + 1; j < sweepOrder.size() && minBounds[sweepOrder[j]].x <= maxBounds[a].x; j++) {
+                size_t b = sweepOrder[j];
+                if(minBounds[b].y <= maxBounds[a].y && minBounds[a].y <= maxBounds[b].y) {
+                    size_t rootA = findRoot(a), rootB = findRoot(b);
+                    if(rootA != rootB) parent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+                }
+            }
+        }
+
+        std::vector<std::vector<size_t>> result;
+        std::vector<size_t> groupOfRoot(polygons.size(), SIZE_MAX);
+        for (size_t i = 0; i < polygons.size(); i++) {
+            size_t root = findRoot(i);
+            if(groupOfRoot[root] == SIZE_MAX) {
+                groupOfRoot[root] = result.size();
+                result.emplace_back();
+            }
+            result[groupOfRoot[root]].push_back(i);
+        }
+        return result;
+    }
+
+
+    /** Runs each stage for all given groups before proceeding to the next one, so progress stays meaningful. */
+    static std::vector<std::shared_ptr<const PolygonGroup>> triangulateGroups(
+            const std::vector<std::vector<glm::dvec2>>& polygons, const std::vector<uint64_t>& polygonHashes,
+            const std::vector<std::vector<size_t>>& groupPolygons, const std::vector<size_t>& changedGroups,
+            unsigned int workerCount, TriangulationProgress& progress, TriangulationStatistics& statistics) {
+        size_t groupCount = changedGroups.size();
+        std::vector<std::shared_ptr<PolygonGroup>> result(groupCount);
+        std::vector<std::vector<std::vector<int>>> polygonVertexIndices(groupCount);
+        parallelFor(groupCount, workerCount, [&](size_t i) {
+            auto group = std::make_shared<PolygonGroup>();
+            for(size_t polygon : groupPolygons[changedGroups[i]]) {
+                std::vector<int> indices;
+                indices.reserve(polygons[polygon].size());
+                for(const glm::dvec2& vertex : polygons[polygon]) {
+                    indices.push_back((int) group->vertices.size());
+                    group->vertices.push_back(vertex);
+                }
+                polygonVertexIndices[i].push_back(std::move(indices));
+                group->polygonHashes.push_back(polygonHashes[polygon]);
+                group->polygonSizes.push_back(polygons[polygon].size());
+            }
+            group->inputVertexCount = group->vertices.size();
+            result[i] = std::move(group);
+        });
+
+        progress.enterStage(TriangulationProgress::STEINER_VERTICES);
+        statistics.enterStage(TriangulationProgress::STEINER_VERTICES);
+        std::vector<std::optional<PolygonGraph>> polygonGraphs(groupCount);
+        parallelFor(groupCount, workerCount, [&](size_t i) {
+            progress.checkCancelled();
+            polygonGraphs[i].emplace(decomposition::insertSteinerVerticesForPolygons(result[i]->vertices, polygonVertexIndices[i]));
+        });
+        polygonVertexIndices = {};
+        for(const std::shared_ptr<PolygonGroup>& group : result) {
+            statistics.stages[TriangulationProgress::STEINER_VERTICES].elements += group->vertices.size() - group->inputVertexCount;
+        }
+
+        progress.enterStage(TriangulationProgress::GRAPH_DECOMPOSITION);
+        statistics.enterStage(TriangulationProgress::GRAPH_DECOMPOSITION);
+        statistics.stages[TriangulationProgress::GRAPH_DECOMPOSITION].elements = groupCount;
+        std::vector<std::optional<DecomposedPolygonGraph>> decomposedGraphs(groupCount);
+        parallelFor(groupCount, workerCount, [&](size_t i) {
+            progress.checkCancelled();
+            decomposedGraphs[i].emplace(decomposition::decomposePolygonGraph(result[i]->vertices, std::move(*polygonGraphs[i])));
+            polygonGraphs[i].reset();
+        });
+
+        progress.enterStage(TriangulationProgress::POLYGON_TREES);
+        statistics.enterStage(TriangulationProgress::POLYGON_TREES);
+        // Group keeps flat copy, nested trees are handed over to area tree builder, which takes them by value
+        std::vector<std::vector<decomposition::PolygonTree>> polygonTrees(groupCount);
+        parallelFor(groupCount, workerCount, [&](size_t i) {
+            progress.checkCancelled();
+            polygonTrees[i] = decomposition::buildPolygonTrees(result[i]->vertices, std::move(*decomposedGraphs[i]));
+            decomposedGraphs[i].reset();
+            result[i]->polygonTree = FlatPolygonTree(polygonTrees[i]);
+        });
+
+        for(const std::shared_ptr<PolygonGroup>& group : result) {
+            statistics.stages[TriangulationProgress::POLYGON_TREES].elements += group->polygonTree.size();
+        }
+
+        progress.enterStage(TriangulationProgress::POLYGON_AREA_TREES);
+        statistics.enterStage(TriangulationProgress::POLYGON_AREA_TREES);
+        std::vector<std::vector<decomposition::PolygonWithHolesTree>> polygonWithHolesTrees(groupCount);
+        parallelFor(groupCount, workerCount, [&](size_t i) {
+            progress.checkCancelled();
+            polygonWithHolesTrees[i] = decomposition::buildPolygonAreaTrees(std::move(polygonTrees[i]));
+        });
+
         // Iterate roots only (do not triangulate overlapping areas more than once)
-        for(const decomposition::PolygonWithHoles& polygon : polygonWithHolesTree) {
-            std::vector<glm::ivec3> polygonTriangles = decomposition::triangulatePolygonWithHoles(vertices, polygon);
-            triangles.reserve(triangles.size() + polygonTriangles.size());
-            triangles.insert(triangles.end(), polygonTriangles.begin(), polygonTriangles.end());
+        std::vector<size_t> groupRootOffsets(groupCount + 1, 0);
+        for (size_t i = 0; i < groupCount; i++) groupRootOffsets[i + 1] = groupRootOffsets[i] + polygonWithHolesTrees[i].size();
+        progress.totalPolygons = groupRootOffsets.back();
+        statistics.stages[TriangulationProgress::POLYGON_AREA_TREES].elements = groupRootOffsets.back();
+        progress.enterStage(TriangulationProgress::TRIANGULATION);
+        statistics.enterStage(TriangulationProgress::TRIANGULATION);
+        std::vector<std::vector<glm::ivec3>> polygonTriangles(groupRootOffsets.back());
+        parallelFor(polygonTriangles.size(), workerCount, [&](size_t i) {
+            progress.checkCancelled();
+            size_t group = std::upper_bound(groupRootOffsets.begin(), groupRootOffsets.end(), i) - groupRootOffsets.begin() - 1;
+            polygonTriangles[i] = decomposition::triangulatePolygonWithHoles(result[group]->vertices,
+                    polygonWithHolesTrees[group][i - groupRootOffsets[group]]);
+            progress.triangulatedPolygons++;
+        });
+        parallelFor(groupCount, workerCount, [&](size_t i) {
+            std::vector<glm::ivec3>& groupTriangles = result[i]->triangles;
+            for (size_t root = groupRootOffsets[i]; root < groupRootOffsets[i + 1]; root++) {
+                groupTriangles.insert(groupTriangles.end(), polygonTriangles[root].begin(), polygonTriangles[root].end());
+            }
+        });
+        for(const std::shared_ptr<PolygonGroup>& group : result) {
+            statistics.stages[TriangulationProgress::TRIANGULATION].elements += group->triangles.size();
+        }
+        statistics.enterStage(TriangulationStatistics::STAGE_COUNT);
+
+        return {result.begin(), result.end()};
+    }
+
+
+    /** Concatenates groups, remapping their local vertex indices into global ones. */
+    void mergeGroups(const std::vector<std::vector<glm::dvec2>>& polygons,
+            const std::vector<std::vector<size_t>>& groupPolygons, unsigned int workerCount) {
+        std::vector<size_t> polygonVertexOffsets(polygons.size() + 1, 0);
+        for (size_t i = 0; i < polygons.size(); i++) polygonVertexOffsets[i + 1] = polygonVertexOffsets[i] + polygons[i].size();
+        std::vector<size_t> steinerVertexOffsets(groups.size() + 1, polygonVertexOffsets.back());
+        std::vector<size_t> triangleOffsets(groups.size() + 1, 0), treeNodeOffsets(groups.size() + 1, 0), treeIndexOffsets(groups.size() + 1, 0);
+        for (size_t i = 0; i < groups.size(); i++) {
+            steinerVertexOffsets[i + 1] = steinerVertexOffsets[i] + groups[i]->vertices.size() - groups[i]->inputVertexCount;
+            triangleOffsets[i + 1] = triangleOffsets[i] + groups[i]->triangles.size();
+            treeNodeOffsets[i + 1] = treeNodeOffsets[i] + groups[i]->polygonTree.nodes.size();
+            treeIndexOffsets[i + 1] = treeIndexOffsets[i] + groups[i]->polygonTree.indices.size();
         }
+
+        vertices.resize(steinerVertexOffsets.back());
+        triangles.resize(triangleOffsets.back());
+        polygonTree.nodes.resize(treeNodeOffsets.back());
+        polygonTree.indices.resize(treeIndexOffsets.back());
+        parallelFor(groups.size(), workerCount, [&](size_t i) {
+            const PolygonGroup& group = *groups[i];
+            std::vector<int> globalIndices;
+            globalIndices.reserve(group.vertices.size());
+            for(size_t polygon : groupPolygons[i]) {
+                for (size_t vertex = polygonVertexOffsets[polygon]; vertex < polygonVertexOffsets[polygon + 1]; vertex++) {
+                    globalIndices.push_back((int) vertex);
+                }
+            }
+            for (size_t vertex = steinerVertexOffsets[i]; vertex < steinerVertexOffsets[i + 1]; vertex++) {
+                globalIndices.push_back((int) vertex);
+            }
+
+            for (size_t vertex = 0; vertex < group.vertices.size(); vertex++) vertices[globalIndices[vertex]] = group.vertices[vertex];
+            for (size_t triangle = 0; triangle < group.triangles.size(); triangle++) {
+                const glm::ivec3& localTriangle = group.triangles[triangle];
+                triangles[triangleOffsets[i] + triangle] = {
+                        globalIndices[localTriangle.x], globalIndices[localTriangle.y], globalIndices[localTriangle.z]
+                };
+            }
+            polygonTree.assign(treeNodeOffsets[i], treeIndexOffsets[i], group.polygonTree, globalIndices);
+        });
     }
 
 
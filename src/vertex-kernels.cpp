@@ -0,0 +1,257 @@
+#include "vertex-kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VERTEX_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET(isa)
+#else
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+
+
+static void narrowScalar(const glm::dvec2* source, glm::vec2* destination, size_t count) {
+    for (size_t i = 0; i < count; i++) destination[i] = glm::vec2(source[i]);
+}
+
+static void expandEdgesScalar(const glm::dvec2* polygon, glm::vec2* destination, size_t count) {
+    if(count == 0) return;
+    for (size_t i = 0; i < count - 1; i++) {
+        destination[i * 2] = glm::vec2(polygon[i]);
+        destination[i * 2 + 1] = glm::vec2(polygon[i + 1]);
+    }
+    destination[count * 2 - 2] = glm::vec2(polygon[count - 1]);
+    destination[count * 2 - 1] = glm::vec2(polygon[0]);
+}
+
+static void computeBoundsScalar(const glm::dvec2* vertices, size_t count, glm::dvec2& min, glm::dvec2& max) {
+    min = max = vertices[0];
+    for (size_t i = 1; i < count; i++) {
+        min = glm::min(min, vertices[i]);
+        max = glm::max(max, vertices[i]);
+    }
+}
+
+static const VertexKernels scalarKernels {"scalar", narrowScalar, expandEdgesScalar, computeBoundsScalar};
+
+
+
+#ifdef VERTEX_KERNELS_X86
+
+// Edge i is (polygon[i], polygon[i + 1]), which are already adjacent in memory, so every edge except the last one
+// is just a narrowed pair of vertices starting at i. Last edge wraps around and is written separately.
+
+TARGET("sse2")
+static void narrowSSE2(const glm::dvec2* source, glm::vec2* destination, size_t count) {
+    auto src = (const double*) source;
+    auto dst = (float*) destination;
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128 a = _mm_cvtpd_ps(_mm_loadu_pd(src + i * 2));
+        __m128 b = _mm_cvtpd_ps(_mm_loadu_pd(src + i * 2 + 2));
+        _mm_storeu_ps(dst + i * 2, _mm_movelh_ps(a, b));
+    }
+    for (; i < count; i++) destination[i] = glm::vec2(source[i]);
+}
+
+TARGET("sse2")
+static void expandEdgesSSE2(const glm::dvec2* polygon, glm::vec2* destination, size_t count) {
+    if(count == 0) return;
+    auto src = (const double*) polygon;
+    auto dst = (float*) destination;
+    for (size_t i = 0; i < count - 1; i++) {
+        __m128 a = _mm_cvtpd_ps(_mm_loadu_pd(src + i * 2));
+        __m128 b = _mm_cvtpd_ps(_mm_loadu_pd(src + i * 2 + 2));
+        _mm_storeu_ps(dst + i * 4, _mm_movelh_ps(a, b));
+    }
+    destination[count * 2 - 2] = glm::vec2(polygon[count - 1]);
+    destination[count * 2 - 1] = glm::vec2(polygon[0]);
+}
+
+TARGET("sse2")
+static void computeBoundsSSE2(const glm::dvec2* vertices, size_t count, glm::dvec2& min, glm::dvec2& max) {
+    auto src = (const double*) vertices;
+    __m128d minimum = _mm_loadu_pd(src), maximum = minimum;
+    for (size_t i = 1; i < count; i++) {
+        __m128d v = _mm_loadu_pd(src + i * 2);
+        minimum = _mm_min_pd(minimum, v);
+        maximum = _mm_max_pd(maximum, v);
+    }
+    _mm_storeu_pd((double*) &min, minimum);
+    _mm_storeu_pd((double*) &max, maximum);
+}
+
+static const VertexKernels sse2Kernels {"sse2", narrowSSE2, expandEdgesSSE2, computeBoundsSSE2};
+
+
+
+TARGET("avx2")
+static void narrowAVX2(const glm::dvec2* source, glm::vec2* destination, size_t count) {
+    auto src = (const double*) source;
+    auto dst = (float*) destination;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i * 2));
+        __m128 b = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i * 2 + 4));
+        _mm256_storeu_ps(dst + i * 2, _mm256_set_m128(b, a));
+    }
+    for (; i < count; i++) destination[i] = glm::vec2(source[i]);
+}
+
+TARGET("avx2")
+static void expandEdgesAVX2(const glm::dvec2* polygon, glm::vec2* destination, size_t count) {
+    if(count == 0) return;
+    auto src = (const double*) polygon;
+    auto dst = (float*) destination;
+    size_t i = 0;
+    for (; i + 2 < count; i += 2) {
+        __m128 a = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i * 2));
+        __m128 b = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i * 2 + 2));
+        _mm256_storeu_ps(dst + i * 4, _mm256_set_m128(b, a));
+    }
+    for (; i < count - 1; i++) {
+        _mm_storeu_ps(dst + i * 4, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i * 2)));
+    }
+    destination[count * 2 - 2] = glm::vec2(polygon[count - 1]);
+    destination[count * 2 - 1] = glm::vec2(polygon[0]);
+}
+
+TARGET("avx2")
+static void computeBoundsAVX2(const glm::dvec2* vertices, size_t count, glm::dvec2& min, glm::dvec2& max) {
+    auto src = (const double*) vertices;
+    __m128d first = _mm_loadu_pd(src);
+    __m256d minimum = _mm256_set_m128d(first, first), maximum = minimum;
+    size_t i = 1;
+    for (; i + 2 <= count; i += 2) {
+        __m256d v = _mm256_loadu_pd(src + i * 2);
+        minimum = _mm256_min_pd(minimum, v);
+        maximum = _mm256_max_pd(maximum, v);
+    }
+    __m128d minimum128 = _mm_min_pd(_mm256_castpd256_pd128(minimum), _mm256_extractf128_pd(minimum, 1));
+    __m128d maximum128 = _mm_max_pd(_mm256_castpd256_pd128(maximum), _mm256_extractf128_pd(maximum, 1));
+    for (; i < count; i++) {
+        __m128d v = _mm_loadu_pd(src + i * 2);
+        minimum128 = _mm_min_pd(minimum128, v);
+        maximum128 = _mm_max_pd(maximum128, v);
+    }
+    _mm_storeu_pd((double*) &min, minimum128);
+    _mm_storeu_pd((double*) &max, maximum128);
+}
+
+static const VertexKernels avx2Kernels {"avx2", narrowAVX2, expandEdgesAVX2, computeBoundsAVX2};
+
+
+
+TARGET("avx512f")
+static void narrowAVX512(const glm::dvec2* source, glm::vec2* destination, size_t count) {
+    auto src = (const double*) source;
+    auto dst = (float*) destination;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 a = _mm512_cvtpd_ps(_mm512_loadu_pd(src + i * 2));
+        __m256 b = _mm512_cvtpd_ps(_mm512_loadu_pd(src + i * 2 + 8));
+        _mm256_storeu_ps(dst + i * 2, a);
+        _mm256_storeu_ps(dst + i * 2 + 8, b);
+    }
+    for (; i < count; i++) destination[i] = glm::vec2(source[i]);
+}
+
+TARGET("avx512f")
+static void expandEdgesAVX512(const glm::dvec2* polygon, glm::vec2* destination, size_t count) {
+    if(count == 0) return;
+    auto src = (const double*) polygon;
+    auto dst = (float*) destination;
+    // Narrowed vertices i..i+3 and i+1..i+4 are interleaved as 64-bit lanes, which gives 4 edges at once
+    const __m512i interleave = _mm512_set_epi64(11, 3, 10, 2, 9, 1, 8, 0);
+    size_t i = 0;
+    for (; i + 4 < count; i += 4) {
+        __m256d a = _mm256_castps_pd(_mm512_cvtpd_ps(_mm512_loadu_pd(src + i * 2)));
+        __m256d b = _mm256_castps_pd(_mm512_cvtpd_ps(_mm512_loadu_pd(src + i * 2 + 2)));
+        __m512d edges = _mm512_permutex2var_pd(_mm512_castpd256_pd512(a), interleave, _mm512_castpd256_pd512(b));
+        _mm512_storeu_pd((double*) (dst + i * 4), edges);
+    }
+    for (; i < count - 1; i++) {
+        _mm_storeu_ps(dst + i * 4, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i * 2)));
+    }
+    destination[count * 2 - 2] = glm::vec2(polygon[count - 1]);
+    destination[count * 2 - 1] = glm::vec2(polygon[0]);
+}
+
+TARGET("avx512f")
+static void computeBoundsAVX512(const glm::dvec2* vertices, size_t count, glm::dvec2& min, glm::dvec2& max) {
+    auto src = (const double*) vertices;
+    __m512d minimum = _mm512_set4_pd(vertices[0].y, vertices[0].x, vertices[0].y, vertices[0].x), maximum = minimum;
+    size_t i = 1;
+    for (; i + 4 <= count; i += 4) {
+        __m512d v = _mm512_loadu_pd(src + i * 2);
+        minimum = _mm512_min_pd(minimum, v);
+        maximum = _mm512_max_pd(maximum, v);
+    }
+    __m256d minimum256 = _mm256_min_pd(_mm512_castpd512_pd256(minimum), _mm512_extractf64x4_pd(minimum, 1));
+    __m256d maximum256 = _mm256_max_pd(_mm512_castpd512_pd256(maximum), _mm512_extractf64x4_pd(maximum, 1));
+    __m128d minimum128 = _mm_min_pd(_mm256_castpd256_pd128(minimum256), _mm256_extractf128_pd(minimum256, 1));
+    __m128d maximum128 = _mm_max_pd(_mm256_castpd256_pd128(maximum256), _mm256_extractf128_pd(maximum256, 1));
+    for (; i < count; i++) {
+        __m128d v = _mm_loadu_pd(src + i * 2);
+        minimum128 = _mm_min_pd(minimum128, v);
+        maximum128 = _mm_max_pd(maximum128, v);
+    }
+    _mm_storeu_pd((double*) &min, minimum128);
+    _mm_storeu_pd((double*) &max, maximum128);
+}
+
+static const VertexKernels avx512Kernels {"avx512", narrowAVX512, expandEdgesAVX512, computeBoundsAVX512};
+
+
+
+enum class InstructionSet {
+    SSE2, AVX2, AVX512
+};
+
+static bool isSupported(InstructionSet instructionSet) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+    if(instructionSet == InstructionSet::SSE2) return sse2;
+    if(!osxsave || !avx || maxLeaf < 7) return false;
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    // YMM state must be enabled by OS for AVX2, and also opmask and ZMM state for AVX-512
+    if(instructionSet == InstructionSet::AVX2) return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+    return (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)) != 0;
+#else
+    __builtin_cpu_init();
+    switch (instructionSet) {
+        case InstructionSet::SSE2: return __builtin_cpu_supports("sse2");
+        case InstructionSet::AVX2: return __builtin_cpu_supports("avx2");
+        case InstructionSet::AVX512: return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#endif
+}
+
+#endif
+
+
+
+std::vector<const VertexKernels*> getSupportedVertexKernels() {
+    std::vector<const VertexKernels*> kernels {&scalarKernels};
+#ifdef VERTEX_KERNELS_X86
+    if(isSupported(InstructionSet::SSE2)) kernels.push_back(&sse2Kernels);
+    if(isSupported(InstructionSet::AVX2)) kernels.push_back(&avx2Kernels);
+    if(isSupported(InstructionSet::AVX512)) kernels.push_back(&avx512Kernels);
+#endif
+    return kernels;
+}
+
+const VertexKernels& getVertexKernels() {
+    static const VertexKernels& kernels = *getSupportedVertexKernels().back();
+    return kernels;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+
+#include <cstddef>
+#include <vector>
+
+#include <glm.hpp>
+
+
+
+/** Bulk vertex processing routines. Several implementations exist for different instruction sets,
+ * best one supported by current CPU is selected once at runtime, falling back to plain scalar code.
+ * Source and destination may be unaligned, destination is usually mapped GPU memory, so it's only written to.
+ */
+struct VertexKernels {
+
+    const char* name;
+
+    /** Converts vertices to single precision. */
+    void (*narrow)(const glm::dvec2* source, glm::vec2* destination, size_t count);
+
+    /** Writes pair of (vertex, next vertex) for every edge of closed polygon, 2 * count vertices in total. */
+    void (*expandEdges)(const glm::dvec2* polygon, glm::vec2* destination, size_t count);
+
+    /** Computes bounding box of vertices, count must not be zero. */
+    void (*computeBounds)(const glm::dvec2* vertices, size_t count, glm::dvec2& min, glm::dvec2& max);
+
+};
+
+
+
+/** Kernels for current CPU. */
+const VertexKernels& getVertexKernels();
+
+/** All kernels supported by current CPU, starting with scalar fallback and ending with the one returned by getVertexKernels(). */
+std::vector<const VertexKernels*> getSupportedVertexKernels();
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+
+/** Measurements of a single frame. GPU values come from timestamp and pipeline statistics queries written around every pass,
+ * CPU upload time covers preparing buffers and recording uploads, present time covers acquiring, submitting and presenting.
+ */
+struct FrameStatistics {
+
+    enum Pass {
+        CULL,
+        TRIANGLES,
+        POLYGON_EDGES,
+        VERTEX_MARKERS,
+        TRIANGLE_EDGES,
+        PASS_COUNT
+    };
+    static constexpr const char* PASS_NAMES[PASS_COUNT] {
+            "Cull", "Triangles", "Polygon edges", "Vertex markers", "Triangle edges"
+    };
+
+    struct PassStatistics {
+        double gpuMilliseconds {0};
+        double primitives {0}, vertexInvocations {0}, fragmentInvocations {0}, computeInvocations {0};
+    };
+
+    PassStatistics passes[PASS_COUNT] {};
+    double uploadMilliseconds {0}, presentMilliseconds {0};
+
+};
+
+
+
+/** Keeps statistics of last frames and averages them */
+class RollingFrameStatistics {
+
+    static constexpr size_t capacity = 64;
+
+    std::vector<FrameStatistics> frames;
+    size_t next {0};
+
+public:
+
+    void add(const FrameStatistics& statistics) {
+        if(frames.size() < capacity) frames.push_back(statistics);
+        else frames[next] = statistics;
+        next = (next + 1) % capacity;
+    }
+
+    void clear() {
+        frames.clear();
+        next = 0;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return frames.size();
+    }
+
+    [[nodiscard]] FrameStatistics average() const {
+        FrameStatistics result;
+        if(frames.empty()) return result;
+        auto count = (double) frames.size();
+        for(const FrameStatistics& frame : frames) {
+            for(size_t i = 0; i < FrameStatistics::PASS_COUNT; i++) {
+                result.passes[i].gpuMilliseconds += frame.passes[i].gpuMilliseconds / count;
+                result.passes[i].primitives += frame.passes[i].primitives / count;
+                result.passes[i].vertexInvocations += frame.passes[i].vertexInvocations / count;
+                result.passes[i].fragmentInvocations += frame.passes[i].fragmentInvocations / count;
+                result.passes[i].computeInvocations += frame.passes[i].computeInvocations / count;
+            }
+            result.uploadMilliseconds += frame.uploadMilliseconds / count;
+            result.presentMilliseconds += frame.presentMilliseconds / count;
+        }
+        return result;
+    }
+
+};
\ No newline at end of file
@@ -43,27 +43,64 @@ public:
     uint32_t minImageCount {0};
     std::optional<vk::PresentModeKHR> presentMode {};
 
+    /**
+     * Settings related to rendering
+     */
+public:
+    /// Number of frames CPU can prepare while GPU is still drawing previous ones
+    uint32_t framesInFlight {2};
+
+    /// Multisampling quality, automatic mode starts at 8x, steps down while GPU frame time exceeds budget and back up once it recovers
+    enum class Antialiasing {
+        OFF,
+        MSAA_4X,
+        MSAA_8X,
+        MAX,
+        AUTO
+    } antialiasing {Antialiasing::MAX};
+    double frameBudgetMilliseconds {8};
+    vk::SampleCountFlags supportedSampleCounts {};
+
+
+    /// Highest supported sample count not exceeding given one
+    [[nodiscard]] vk::SampleCountFlagBits selectSampleCount(uint32_t maxSamples) const {
+        for(uint32_t samples = 64; samples > 1; samples /= 2) {
+            auto bit = (vk::SampleCountFlagBits) samples;
+            if(samples <= maxSamples && (supportedSampleCounts & bit) == bit) return bit;
+        }
+        return vk::SampleCountFlagBits::e1;
+    }
+
+    [[nodiscard]] vk::SampleCountFlagBits selectSampleCount(Antialiasing mode) const {
+        switch(mode) {
+            case Antialiasing::OFF: return vk::SampleCountFlagBits::e1;
+            case Antialiasing::MSAA_4X: return selectSampleCount(4);
+            case Antialiasing::MSAA_8X:
+            case Antialiasing::AUTO: return selectSampleCount(8);
+            default: return selectSampleCount(64);
+        }
+    }
+
 
 
 
 
     void validate(const PhysicalDeviceProperties& properties) {
-        vk::SurfaceCapabilitiesKHR surfaceCapabilities = properties.getSurfaceCapabilities();
 
 
 
         // Properties setup
 
         { // Multisampling
-            vk::SampleCountFlags samples = properties.physicalDeviceProperties.limits.framebufferColorSampleCounts;
-            if((samples & vk::SampleCountFlagBits::e64) == vk::SampleCountFlagBits::e64) sampleCount = vk::SampleCountFlagBits::e64;
-            else if((samples & vk::SampleCountFlagBits::e32) == vk::SampleCountFlagBits::e32) sampleCount = vk::SampleCountFlagBits::e32;
-            else if((samples & vk::SampleCountFlagBits::e16) == vk::SampleCountFlagBits::e16) sampleCount = vk::SampleCountFlagBits::e16;
-            else if((samples & vk::SampleCountFlagBits::e8) == vk::SampleCountFlagBits::e8) sampleCount = vk::SampleCountFlagBits::e8;
-            else if((samples & vk::SampleCountFlagBits::e4) == vk::SampleCountFlagBits::e4) sampleCount = vk::SampleCountFlagBits::e4;
-            else if((samples & vk::SampleCountFlagBits::e2) == vk::SampleCountFlagBits::e2) sampleCount = vk::SampleCountFlagBits::e2;
-            else sampleCount = vk::SampleCountFlagBits::e1;
+            supportedSampleCounts = properties.physicalDeviceProperties.limits.framebufferColorSampleCounts;
+            sampleCount = selectSampleCount(antialiasing);
+        }
+
+        if(!properties.surface) {
+            validateOffscreen(properties);
+            return;
         }
+        vk::SurfaceCapabilitiesKHR surfaceCapabilities = properties.getSurfaceCapabilities();
 
         { // Format
             if(properties.surfaceFormats.empty()) throw GraphicRequirementsNotSatisfiedException("No applicable graphic format");
@@ -116,5 +153,27 @@ public:
                 minImageCount = surfaceCapabilities.maxImageCount < imageCount ? surfaceCapabilities.maxImageCount : imageCount;
             }
         }
+
+        { // Frames in flight
+            if(framesInFlight == 0) framesInFlight = 1;
+        }
+    }
+
+    /** Without surface we render into our own images, which are then copied to host memory as RGBA */
+    void validateOffscreen(const PhysicalDeviceProperties& properties) {
+        { // Format
+            imageFormat = vk::Format::eR8G8B8A8Unorm;
+            vk::FormatFeatureFlags features = properties.physicalDevice.getFormatProperties(imageFormat).optimalTilingFeatures;
+            vk::FormatFeatureFlags requiredFeatures = vk::FormatFeatureFlagBits::eColorAttachment | vk::FormatFeatureFlagBits::eTransferSrc;
+            if((features & requiredFeatures) != requiredFeatures) throw GraphicRequirementsNotSatisfiedException("No applicable offscreen image format");
+        }
+
+        { // Image usage
+            imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+        }
+
+        { // Frames in flight
+            if(framesInFlight == 0) framesInFlight = 1;
+        }
     }
 };
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 
 extern vk::Instance vkInstance;
+extern bool vkSurfaceSupported;
 
 
 
@@ -81,14 +82,19 @@ class JAWTVulkanRendererImpl : public JAWTVulkanRenderer {
     vk::UniqueSurfaceKHR surface;
 
     VulkanRenderer renderer {};
+    /** Applied to every renderer, as it is created again when surface changes */
+    bool profiling {false};
+    GraphicSettings::Antialiasing antialiasing {GraphicSettings::Antialiasing::MAX};
+    /** Zero keeps default of graphic settings */
+    uint32_t framesInFlight {0};
 
 public:
     explicit JAWTVulkanRendererImpl(JNIEnv* jni) {
+        if(!vkSurfaceSupported) throw std::runtime_error("Vulkan surface extensions are not supported");
         if(JAWT_GetAWT(jni, &jawt) == JNI_FALSE) throw std::runtime_error("JAWT Not found");
     }
 
-    void render(JNIEnv* jni, jobject javaVulkanRenderer, const std::vector<std::vector<glm::dvec2>>& polygonSet,
-                const Triangulation* const triangulation, glm::dvec2 scale) final {
+    void render(JNIEnv* jni, jobject javaVulkanRenderer, const Triangulation* const triangulation, glm::dvec2 scale, glm::dvec2 offset) final {
         bool justRetrievedDrawingSurface = false;
         if(jawtDrawingSurface == nullptr) {
             jawtDrawingSurface = jawt.GetDrawingSurface(jni, javaVulkanRenderer);
@@ -98,13 +104,40 @@ public:
         Lock lock(jawtDrawingSurface, lastDrawingSurfaceBounds);
         lastDrawingSurfaceBounds = lock.jawtDrawingSurfaceInfo->bounds;
         if(lock.surfaceChanged || justRetrievedDrawingSurface) {
+            // Shared device stays alive while renderer is recreated, even if this is its only renderer
+            std::shared_ptr<DeviceContext> deviceContext = renderer.deviceContext;
             renderer = {};
             surface = {};
             surface = createSurface(vkInstance, *lock.jawtDrawingSurfaceInfo);
             renderer = VulkanRenderer(vkInstance, *surface);
+            renderer.setAntialiasing(antialiasing);
+            renderer.setProfiling(profiling);
+            if(framesInFlight != 0) renderer.setFramesInFlight(framesInFlight);
         }
         if(lock.boundsChanged || justRetrievedDrawingSurface) renderer.updateSwapchainContext();
-        renderer.render(polygonSet, triangulation, scale);
+        renderer.render(polygonSet.polygons, polygonSet.version, triangulation, scale, offset);
+    }
+
+    void setProfiling(bool enabled) final {
+        profiling = enabled;
+        if(renderer) renderer.setProfiling(enabled);
+    }
+
+    void setAntialiasing(int mode) final {
+        if(mode < (int) GraphicSettings::Antialiasing::OFF || mode > (int) GraphicSettings::Antialiasing::AUTO)
+            throw std::invalid_argument("Unknown antialiasing mode");
+        antialiasing = (GraphicSettings::Antialiasing) mode;
+        if(renderer) renderer.setAntialiasing(antialiasing);
+    }
+
+    void setFramesInFlight(int count) final {
+        if(count < 1) throw std::invalid_argument("At least one frame must be in flight");
+        framesInFlight = (uint32_t) count;
+        if(renderer) renderer.setFramesInFlight(framesInFlight);
+    }
+
+    [[nodiscard]] FrameStatistics getStatistics() const final {
+        return renderer ? renderer.getStatistics() : FrameStatistics{};
     }
 
     ~JAWTVulkanRendererImpl() final {
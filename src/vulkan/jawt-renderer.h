@@ -1,16 +1,44 @@
 #pragma once
 
 
+#include <memory>
 #include <jawt_md.h>
 #include <glm.hpp>
 
+#include "frame-statistics.h"
+#include "../command-channel.h"
+
+
+
+/** Native copy of Java polygon set bound to renderer. Java increments generation of polygon set on every edit,
+ * so it is converted again only when generation or polygon set object itself changes, which increments version.
+ */
+struct BoundPolygonSet {
+    jweak source {nullptr};
+    jlong sourceGeneration {0};
+    uint64_t version {0};
+    std::vector<std::vector<glm::dvec2>> polygons;
+};
+
 
 
 class JAWTVulkanRenderer {
 public:
 
-    virtual void render(JNIEnv* jni, jobject javaVulkanRenderer, const std::vector<std::vector<glm::dvec2>>& polygonSet,
-                        const Triangulation* triangulation, glm::dvec2 scale) = 0;
+    BoundPolygonSet polygonSet;
+    /** Bound by Java for batched edits, triangulation requested through it replaces the Java one when painting */
+    std::unique_ptr<CommandChannel> commandChannel;
+    std::shared_ptr<Triangulation> commandTriangulation;
+
+    virtual void render(JNIEnv* jni, jobject javaVulkanRenderer, const Triangulation* triangulation, glm::dvec2 scale, glm::dvec2 offset) = 0;
+
+    virtual void setProfiling(bool enabled) = 0;
+
+    virtual void setAntialiasing(int mode) = 0;
+
+    virtual void setFramesInFlight(int count) = 0;
+
+    [[nodiscard]] virtual FrameStatistics getStatistics() const = 0;
 
     virtual ~JAWTVulkanRenderer() = default;
 
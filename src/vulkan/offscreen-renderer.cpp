@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <cstring>
+
+#include "../triangulation.h"
+#include "offscreen-renderer.h"
+#include "include.h"
+#include "renderer.h"
+
+
+extern vk::Instance vkInstance;
+
+
+
+class OffscreenVulkanRendererImpl : public OffscreenVulkanRenderer {
+
+    VulkanRenderer renderer;
+
+public:
+    OffscreenVulkanRendererImpl(uint32_t width, uint32_t height) : renderer(vkInstance, vk::Extent2D{width, height}) {}
+
+    void render(const std::vector<std::vector<std::vector<glm::dvec2>>>& polygonSets,
+                const std::vector<const Triangulation*>& triangulations,
+                glm::dvec2 scale, glm::dvec2 offset, uint8_t* pixels) final {
+        vk::Extent2D extent = renderer.extent();
+        size_t imageSize = (size_t) extent.width * extent.height * 4;
+        // There may be fewer triangulations than polygon sets, the rest is drawn without any
+        std::vector<const Triangulation*> setTriangulations(polygonSets.size(), nullptr);
+        std::copy_n(triangulations.begin(), std::min(triangulations.size(), polygonSets.size()), setTriangulations.begin());
+        // Every frame renders a batch of consecutive polygon sets with one submission. Frames in flight are pipelined:
+        // a frame is read back only right before it is reused, so CPU prepares and GPU renders next batches meanwhile
+        struct Batch {
+            size_t first, count;
+        };
+        std::vector<std::optional<Batch>> pendingBatches;
+        auto readback = [&](uint32_t frame) {
+            if(frame < pendingBatches.size() && pendingBatches[frame]) {
+                std::memcpy(pixels + pendingBatches[frame]->first * imageSize, renderer.readback(frame), pendingBatches[frame]->count * imageSize);
+                pendingBatches[frame].reset();
+            }
+        };
+        for(size_t first = 0; first < polygonSets.size();) {
+            auto count = (uint32_t) std::min<size_t>(renderer.offscreenBatchSize(), polygonSets.size() - first);
+            uint32_t frame = renderer.nextFrameIndex();
+            readback(frame);
+            renderer.renderOffscreen(polygonSets.data() + first, setTriangulations.data() + first, count, scale, offset);
+            if(pendingBatches.size() <= frame) pendingBatches.resize(frame + 1);
+            pendingBatches[frame] = Batch{first, count};
+            first += count;
+        }
+        for(uint32_t frame = 0; frame < pendingBatches.size(); frame++) readback(frame);
+    }
+
+    [[nodiscard]] uint32_t getWidth() const final {
+        return renderer.extent().width;
+    }
+
+    [[nodiscard]] uint32_t getHeight() const final {
+        return renderer.extent().height;
+    }
+
+};
+
+
+OffscreenVulkanRenderer* createOffscreenVulkanRenderer(uint32_t width, uint32_t height) {
+    return new OffscreenVulkanRendererImpl(width, height);
+}
+
+void destroyOffscreenVulkanRenderer(OffscreenVulkanRenderer* renderer) {
+    delete renderer;
+}
\ No newline at end of file
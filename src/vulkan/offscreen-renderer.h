@@ -0,0 +1,32 @@
+#pragma once
+
+
+#include <cstdint>
+#include <vector>
+#include <glm.hpp>
+
+
+struct Triangulation;
+
+
+
+/** Renders polygon sets without any window, for example to export images. Every polygon set is drawn with the same view
+ * into its own image, results are tightly packed RGBA rows with no padding between images.
+ * Several polygon sets are drawn with one submission, as many as fit into a single framebuffer.
+ */
+class OffscreenVulkanRenderer {
+public:
+
+    virtual void render(const std::vector<std::vector<std::vector<glm::dvec2>>>& polygonSets,
+                        const std::vector<const Triangulation*>& triangulations,
+                        glm::dvec2 scale, glm::dvec2 offset, uint8_t* pixels) = 0;
+
+    [[nodiscard]] virtual uint32_t getWidth() const = 0;
+    [[nodiscard]] virtual uint32_t getHeight() const = 0;
+
+    virtual ~OffscreenVulkanRenderer() = default;
+
+};
+
+OffscreenVulkanRenderer* createOffscreenVulkanRenderer(uint32_t width, uint32_t height);
+void destroyOffscreenVulkanRenderer(OffscreenVulkanRenderer*);
\ No newline at end of file
@@ -15,10 +15,13 @@ public:
     std::vector<vk::PresentModeKHR> surfacePresentModes;
 
     PhysicalDeviceProperties() = default;
+    /** Surface may be null when rendering offscreen, then surface formats and present modes stay empty */
     PhysicalDeviceProperties(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface) :
-            physicalDevice(physicalDevice), surface(surface),
-            surfaceFormats(physicalDevice.getSurfaceFormatsKHR(surface)),
-            surfacePresentModes(physicalDevice.getSurfacePresentModesKHR(surface)) {
+            physicalDevice(physicalDevice), surface(surface) {
+        if(surface) {
+            surfaceFormats = physicalDevice.getSurfaceFormatsKHR(surface);
+            surfacePresentModes = physicalDevice.getSurfacePresentModesKHR(surface);
+        }
         vk::PhysicalDeviceProperties2 physicalDeviceProperties2;
         physicalDeviceProperties2.pNext = &subgroupProperties;
         physicalDevice.getProperties2(&physicalDeviceProperties2);
@@ -0,0 +1,129 @@
+#pragma once
+
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include "rendering-context.h"
+
+
+
+/** Pipeline cache data persisted in a file per device. Renderers of a device share one vk::PipelineCache
+ * created from this data by the first of them, and every renderer creating new pipelines stores the data back.
+ * Files are keyed by vendor, device and pipeline cache UUID, so that driver updates simply start with a new cache.
+ */
+class PipelineCacheStorage {
+
+    static inline std::mutex mutex;
+    static inline std::unordered_map<std::string, std::vector<uint8_t>> cacheData;
+
+
+    static std::string getKey(const vk::PhysicalDeviceProperties& properties) {
+        std::ostringstream key;
+        key << std::hex << std::setfill('0') << std::setw(8) << properties.vendorID << '-' << std::setw(8) << properties.deviceID << '-';
+        for(uint8_t byte : properties.pipelineCacheUUID) key << std::setw(2) << (int) byte;
+        return key.str();
+    }
+
+    /** Cache directory can be overridden by DECOMPOSITION_VIEWER_CACHE_DIR, empty path disables persistence */
+    static std::filesystem::path getDirectory() {
+        if(const char* directory = std::getenv("DECOMPOSITION_VIEWER_CACHE_DIR")) return directory;
+#if defined(_WIN32)
+        if(const char* localAppData = std::getenv("LOCALAPPDATA")) return std::filesystem::path(localAppData) / "decomposition-viewer";
+#else
+        if(const char* xdgCacheHome = std::getenv("XDG_CACHE_HOME")) return std::filesystem::path(xdgCacheHome) / "decomposition-viewer";
+        if(const char* home = std::getenv("HOME")) return std::filesystem::path(home) / ".cache" / "decomposition-viewer";
+#endif
+        return {};
+    }
+
+    static std::filesystem::path getFile(const std::string& key) {
+        std::filesystem::path directory = getDirectory();
+        return directory.empty() ? directory : directory / ("pipeline-cache-" + key + ".bin");
+    }
+
+    /** Checks header written by driver, so that we never pass data of other device or driver version */
+    static bool isCompatible(const std::vector<uint8_t>& data, const vk::PhysicalDeviceProperties& properties) {
+        struct {
+            uint32_t headerSize, headerVersion, vendorID, deviceID;
+            uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        } header {};
+        if(data.size() < sizeof(header)) return false;
+        std::memcpy(&header, data.data(), sizeof(header));
+        return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+               std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+    }
+
+    static std::vector<uint8_t> readFile(const std::filesystem::path& file) {
+        std::ifstream stream(file, std::ios::binary);
+        if(!stream) return {};
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+
+    /** Writes into temporary file first, so that concurrent processes never see partially written cache */
+    static void writeFile(const std::filesystem::path& file, const std::vector<uint8_t>& data) {
+        std::error_code error;
+        std::filesystem::create_directories(file.parent_path(), error);
+        std::filesystem::path temporaryFile = file;
+        temporaryFile += ".tmp";
+        {
+            std::ofstream stream(temporaryFile, std::ios::binary | std::ios::trunc);
+            stream.write((const char*) data.data(), (std::streamsize) data.size());
+            if(!stream) {
+                std::cerr << "Cannot write pipeline cache " << temporaryFile << std::endl;
+                return;
+            }
+        }
+        std::filesystem::rename(temporaryFile, file, error);
+        if(error) std::cerr << "Cannot write pipeline cache " << file << ": " << error.message() << std::endl;
+    }
+
+
+public:
+    /** Sets warm when cache starts with data of an earlier device context or a previous run */
+    static vk::UniquePipelineCache load(vk::Device device, const vk::PhysicalDeviceProperties& properties, bool& warm) {
+        std::string key = getKey(properties);
+        std::vector<uint8_t> data;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto cached = cacheData.find(key);
+            if(cached != cacheData.end()) data = cached->second;
+        }
+        if(data.empty()) {
+            std::filesystem::path file = getFile(key);
+            if(!file.empty()) data = readFile(file);
+            if(!isCompatible(data, properties)) data.clear();
+            std::lock_guard<std::mutex> lock(mutex);
+            if(cacheData[key].empty()) cacheData[key] = data;
+        }
+        warm = !data.empty();
+        return device.createPipelineCacheUnique(vk::PipelineCacheCreateInfo{
+                /*flags*/           {},
+                /*initialDataSize*/ data.size(),
+                /*pInitialData*/    data.data()
+        });
+    }
+
+    /** Makes pipelines of given cache available to renderers created later, writes the file only when cache grew */
+    static void store(vk::Device device, vk::PipelineCache pipelineCache, const vk::PhysicalDeviceProperties& properties) {
+        std::string key = getKey(properties);
+        std::vector<uint8_t> data = device.getPipelineCacheData(pipelineCache);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<uint8_t>& cached = cacheData[key];
+            if(data.size() <= cached.size()) return;
+            cached = data;
+        }
+        std::filesystem::path file = getFile(key);
+        if(!file.empty()) writeFile(file, data);
+    }
+
+};
\ No newline at end of file
@@ -1,9 +1,21 @@
 #pragma once
 
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <unordered_map>
+
 #include "rendering-context.h"
+#include "pipeline-cache.h"
+#include "frame-statistics.h"
 #include "swapchain.h"
 #include "shader-module.h"
+#include "../parallel.h"
+#include "../vertex-kernels.h"
 
 
 template <typename Type>
@@ -17,34 +29,219 @@ static inline Type operator!(const vk::ResultValue<Type>& r) {
 class VulkanRenderer : public RenderingContext {
 
 
-    vk::UniqueSemaphore acquireImageSemaphore, renderingCompleteSemaphore;
-    vk::UniqueFence renderingCompleteFence;
+    /** Layouts, shaders and pipelines are owned by device context, render pass is compatible with the one they were created for */
     vk::UniqueRenderPass renderPass;
-    vk::UniqueDescriptorSetLayout descriptorSetLayout;
-    vk::UniquePipelineLayout pipelineLayout;
-    vk::UniqueShaderModule vertexShader, triangleFragmentShader, flatFragmentShader, triangleVertexGeometryShader;
-    vk::UniquePipeline trianglePipeline, triangleEdgePipeline, polygonEdgePipeline, polygonVertexPipeline;
+    std::shared_ptr<const DeviceContext::GraphicsPipelines> pipelines;
     vk::UniqueDescriptorPool descriptorPool;
-    vk::DescriptorSet descriptorSet;
 
-    vma::StreamBuffer uniformBuffer;
-    vma::StreamBuffer vertexBuffer;
-    vma::StreamBuffer triangleIndexBuffer, triangleDrawIndirectBuffer;
-    vma::StreamBuffer polygonVerticesBuffer, polygonDrawIndirectBuffer;
+    /** Radius of polygon vertex markers, in the same units as polygon coordinates */
+    float vertexMarkerRadius {10};
+    bool drawIndirectFirstInstance {false};
+    /** Triangles and outlines are culled by compute shader, which needs multiple draws per indirect call.
+     * Frame is culled only while its chunks fit into maxDrawIndirectCount draws, otherwise everything is drawn at once.
+     */
+    bool gpuCulling {false};
+    uint32_t maxDrawIndirectCount {1};
+    /** Culled draws take their count from draw buffer, without it every draw up to chunk capacity is issued and empty ones do nothing */
+    bool drawIndirectCount {false};
+
+    /** Profiling is optional, as queries add small overhead to every frame */
+    bool profiling {false};
+    /** Nanoseconds per timestamp tick and mask of valid timestamp bits, there are no timestamps if mask is zero */
+    double timestampPeriod {0};
+    uint64_t timestampMask {0};
+    RollingFrameStatistics statistics;
+    static constexpr vk::QueryPipelineStatisticFlags pipelineStatisticFlags =
+            vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives | vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+            vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations | vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+
+
+    /** Draw buffer starts with compaction counters, followed by triangle draws and outline draws */
+    static constexpr vk::DeviceSize cullDrawsOffset = sizeof(uint32_t) * 4;
+    /** Chunk sizes, in triangles and in outline indices */
+    static constexpr size_t chunkTriangles = 256, chunkPolygonIndices = 1024;
+
+
+    /** Matches uniform block of shaders */
+    struct Uniform {
+        glm::vec2 extent, offset;
+        uint32_t triangleFirstIndex, polygonFirstIndex;
+        int32_t polygonVertexOffset;
+        uint32_t triangleChunkCount, polygonChunkFirst, polygonChunkCount;
+    };
+
+    /** Contiguous range of triangle or outline indices with bounding box, which is culled as a whole.
+     * First index is relative to the beginning of its stream.
+     */
+    struct Chunk {
+        glm::vec2 min, max;
+        uint32_t firstIndex, indexCount;
+    };
+
+    /** Range of outline indices and their chunks forming one level of detail */
+    struct PolygonLevel {
+        double tolerance;
+        uint32_t firstIndex, indexCount, firstChunk, chunkCount;
+    };
+    static constexpr uint32_t maxPolygonLevels = 8;
+
+    /** Outline indices and chunks of all levels of detail one after another */
+    struct PolygonOutline {
+        std::vector<Chunk> chunks;
+        std::vector<uint32_t> indices;
+        std::vector<PolygonLevel> levels;
+    };
+
+    /** Chunks depend only on triangulation or polygon set, so they are built once and uploaded into every frame.
+     * Outline changes also when coarser levels of the same polygon set are finished, which bumps its revision.
+     */
+    std::vector<Chunk> triangleChunks;
+    PolygonOutline polygonOutline;
+    uint64_t polygonOutlineRevision {0};
+    std::optional<uint64_t> triangleChunksTriangulationId, polygonChunksVersion;
+
+    /** Coarser outline levels of polygon sets with at least this many vertices are built in background */
+    static constexpr size_t asyncPolygonLevelsVertices = 16384;
+    std::shared_ptr<std::atomic<bool>> polygonLevelsCancelled;
+    std::future<PolygonOutline> polygonLevelsBuild;
+    /** Cancelled builds are kept until they return, as destroying their futures would wait for them */
+    std::vector<std::future<PolygonOutline>> cancelledPolygonLevelsBuilds;
+
+    /** Everything CPU writes while preparing a frame. There are several frames in flight, so CPU can fill buffers
+     * of the next frame while GPU is still drawing previous ones. Each frame is guarded by its own fence.
+     */
+    struct Frame {
+
+        vk::UniqueSemaphore acquireImageSemaphore, renderingCompleteSemaphore;
+        vk::UniqueFence renderingCompleteFence;
+
+        vk::DescriptorSet descriptorSet, cullDescriptorSet;
+
+        vma::StreamBuffer uniformBuffer;
+        vma::StreamBuffer triangleDrawIndirectBuffer, polygonDrawIndirectBuffer, vertexMarkerDrawIndirectBuffer;
+
+        /** Device-local buffer holding triangulation vertices, then triangle indices, then polygon vertices,
+         * then polygon outline indices. Polygon vertices are used both by outlines and as vertex marker instances,
+         * they are omitted when triangulation vertices already start with them.
+         * Every frame has its own, so copies into it only wait for this frame's previous submission, which is already
+         * complete once its fence is signaled, and never for other frames in flight. Changed geometry is therefore
+         * uploaded once per frame in flight. It stays bound while offsets of its regions are passed through
+         * indirect draw arguments, so command buffers are re-recorded only when it has to grow.
+         */
+        vma::DeviceBuffer geometryBuffer;
+        vk::DeviceSize triangleIndicesOffset {0}, polygonVerticesOffset {0}, polygonIndicesOffset {0};
+        bool reusesTriangulationVertices {false};
+        /** Identify geometry currently stored in geometry buffer, so that it's uploaded again only when changed */
+        std::optional<uint64_t> uploadedPolygonSetVersion, uploadedPolygonOutlineRevision, uploadedTriangulationId;
+        std::optional<vk::DeviceSize> recordedPolygonVerticesOffset;
+
+        /** Offscreen, frame renders a batch of images one below another into its framebuffer, with a single submission.
+         * Every image has its own region of geometry buffer and its own draw arguments, stored one after another.
+         * Without drawIndirectFirstInstance, vertex markers of every image are bound at its polygon vertices.
+         * With surface, batch is empty and the frame renders one image as described above.
+         */
+        uint32_t batchImageCount {0};
+        std::vector<vk::DeviceSize> batchPolygonVerticesOffsets;
+
+        /** Chunks of triangles followed by chunks of outlines, and draw commands written for the visible ones.
+         * Draw buffer starts with 4 counters used for compaction, which are also draw counts. Both grow only when capacity is exceeded.
+         */
+        bool culling {false};
+        vma::DeviceBuffer chunkBuffer, drawBuffer;
+        uint32_t triangleChunkCapacity {0}, polygonChunkCapacity {0};
+        uint32_t triangleChunkCount {0};
+
+        /** Geometry and chunks are written into staging ring and then copied into device-local buffers.
+         * Ring position is retired once this frame's fence is signaled. Only bytes staged by this frame are flushed.
+         */
+        vk::DeviceSize stagingBegin {0}, stagingOffset {0}, stagingRingPosition {0};
+        std::vector<std::pair<vk::Buffer, vk::BufferCopy>> stagedCopies;
+
+        /** Identify chunks currently stored in chunk buffer, so that they're uploaded again only when changed */
+        std::optional<uint64_t> chunkPolygonOutlineRevision, chunkTriangulationId;
+
+        /** Command buffers are recorded for each swapchain image, as they reference buffers of this frame.
+         * Offscreen, there is just one, drawing into frame's own image.
+         */
+        vk::UniqueCommandPool commandPool;
+        std::vector<vk::CommandBuffer> commandBuffers;
+        /** Set when targets changed, command buffers are reallocated and recorded once this frame's fence is signaled */
+        bool targetOutdated {false};
+
+        /** Submission number of the last time this frame was submitted */
+        uint64_t serial {0};
+
+        vk::UniqueCommandPool uploadCommandPool;
+        vk::CommandBuffer uploadCommandBuffer;
+
+        /** Receives pixels of offscreen image, tightly packed RGBA rows */
+        vma::StreamBuffer readbackBuffer;
+
+        /** Queries written while profiling, they are read once the frame's fence is signaled before it is reused.
+         * CPU part of statistics is measured at submit and completed with GPU results then.
+         */
+        vk::UniqueQueryPool timestampQueryPool, statisticsQueryPool;
+        bool queriesPending {false};
+        FrameStatistics pendingStatistics;
+        std::chrono::steady_clock::time_point uploadStart;
+
+    };
+
+    std::vector<Frame> frames;
+    uint32_t frameIndex {0};
+
+    vma::RingBuffer stagingRing;
 
     Swapchain swapchain;
 
-    struct SwapchainContext {
+    /** Images rendered into. With surface, these are swapchain images and every frame records command buffers for each
+     * of them. Offscreen, every frame in flight owns one image, which is copied into frame's readback buffer after drawing.
+     */
+    struct TargetContext {
+
+        /** Extent of one image. Offscreen, framebuffer stacks a batch of images vertically, with surface it's the same */
+        vk::Extent2D extent, framebufferExtent;
 
+        /** Multisampled image may be larger than framebuffer, see createMultisampledImage(). There is none without multisampling */
         vma::UnmappedImage image;
+        vk::Extent2D imageExtent;
+        std::vector<vma::UnmappedImage> offscreenImages;
 
         std::vector<vk::UniqueFramebuffer> framebuffers;
 
-        std::vector<vk::CommandBuffer> commandBuffers;
+    } targetContext;
 
-    } swapchainContext;
+    bool offscreen {false};
+    /** Number of images rendered by one offscreen frame, limited by image dimensions and readback memory */
+    uint32_t offscreenBatch {1};
+    static constexpr uint32_t maxOffscreenBatch = 16;
+    static constexpr vk::DeviceSize maxOffscreenBatchBytes = 64 * 1024 * 1024;
 
-    vk::UniqueCommandPool commandPool;
+    /** Swapchain is recreated on resize without waiting for GPU. Previous swapchain and its targets are kept
+     * until all frames submitted before recreation are complete. Frames complete in submission order,
+     * so it's enough to compare submission numbers. Staging ring replaced by a larger one is retired the same way.
+     */
+    struct RetiredTarget {
+        uint64_t serial;
+        Swapchain swapchain;
+        TargetContext targetContext;
+        vk::UniqueRenderPass renderPass;
+        std::shared_ptr<const DeviceContext::GraphicsPipelines> pipelines;
+        vma::RingBuffer stagingRing;
+    };
+    std::deque<RetiredTarget> retiredTargets;
+    uint64_t submittedSerial {0}, completedSerial {0};
+
+    /** Set when surface reported out of date or suboptimal swapchain, or when it has zero size */
+    bool swapchainOutOfDate {false};
+
+    /** GPU frame time accumulated by automatic antialiasing since the last decision. Sample count steps back up only
+     * after several consecutive windows well below budget, so that it doesn't oscillate around the budget.
+     */
+    static constexpr uint32_t antialiasingWindow = 32, antialiasingRecoveryWindows = 4;
+    static constexpr double antialiasingRecoveryBudgetFraction = 0.4;
+    double antialiasingMilliseconds {0};
+    uint32_t antialiasingFrames {0}, antialiasingRecoveredWindows {0};
 
 
 public:
@@ -60,21 +257,278 @@ public:
         return *this;
     }
     ~VulkanRenderer() {
-        if(device) device->waitIdle();
+        cancelPolygonLevels();
+        // Device is shared with other renderers, so only work of this one is waited for
+        if(deviceContext) for(Frame& frame : frames) device.waitForFences({*frame.renderingCompleteFence}, true, -1);
+    }
+    inline operator bool() const { return static_cast<bool>(deviceContext); } // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+    /** Renders offscreen into images of given size, without any surface or swapchain */
+    explicit VulkanRenderer(vk::Instance vk, vk::Extent2D extent) : VulkanRenderer(vk, vk::SurfaceKHR()) {
+        updateOffscreenContext(extent);
     }
     explicit VulkanRenderer(vk::Instance vk, vk::SurfaceKHR surface) :
     RenderingContext(createRenderingContext(vk, surface)) {
 
-        acquireImageSemaphore = device->createSemaphoreUnique({});
-        renderingCompleteSemaphore = device->createSemaphoreUnique({});
-        renderingCompleteFence = device->createFenceUnique({vk::FenceCreateFlagBits::eSignaled});
+        offscreen = !surface;
+        drawIndirectFirstInstance = physicalDeviceProperties.physicalDeviceFeatures.drawIndirectFirstInstance;
+        gpuCulling = physicalDeviceProperties.physicalDeviceFeatures.multiDrawIndirect;
+        maxDrawIndirectCount = physicalDeviceProperties.physicalDeviceProperties.limits.maxDrawIndirectCount;
+        drawIndirectCount = deviceContext->drawIndirectCountSupported;
+        uint32_t timestampValidBits = physicalDeviceProperties.physicalDevice.getQueueFamilyProperties()[queueFamily].timestampValidBits;
+        timestampMask = timestampValidBits >= 64 ? UINT64_MAX : (1ULL << timestampValidBits) - 1;
+        timestampPeriod = physicalDeviceProperties.physicalDeviceProperties.limits.timestampPeriod;
+
+        stagingRing = vma::RingBuffer(vma, 16 * 1024 * 1024, vk::BufferUsageFlagBits::eTransferSrc);
+
+
+        createRenderPass();
+
+        {
+            std::lock_guard<std::mutex> lock(deviceContext->pipelineMutex);
+            if(!deviceContext->pipelineLayout) createSharedPipelineObjects(*deviceContext);
+        }
+        createGraphicsPipelines();
+        createFrames();
+    }
+
+
+
+    /** Creates every frame in flight with its synchronization, command pools, queries, descriptor sets and host-visible buffers.
+     * Frames have no command buffers until targets are set up.
+     */
+    void createFrames() {
+        frames.resize(graphicSettings.framesInFlight);
+        for(Frame& frame : frames) {
+            frame.acquireImageSemaphore = device.createSemaphoreUnique({});
+            frame.renderingCompleteSemaphore = device.createSemaphoreUnique({});
+            frame.renderingCompleteFence = device.createFenceUnique({vk::FenceCreateFlagBits::eSignaled});
+
+            frame.commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+                    /*flags*/            {},
+                    /*queueFamilyIndex*/ queueFamily
+            });
+            frame.uploadCommandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+                    /*flags*/            vk::CommandPoolCreateFlagBits::eTransient,
+                    /*queueFamilyIndex*/ queueFamily
+            });
+            frame.uploadCommandBuffer = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{
+                    /*commandPool*/        *frame.uploadCommandPool,
+                    /*level*/              vk::CommandBufferLevel::ePrimary,
+                    /*commandBufferCount*/ 1
+            }).front();
+
+            if(timestampMask != 0) {
+                frame.timestampQueryPool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+                        /*flags*/              {},
+                        /*queryType*/          vk::QueryType::eTimestamp,
+                        /*queryCount*/         FrameStatistics::PASS_COUNT + 1,
+                        /*pipelineStatistics*/ {}
+                });
+            }
+            if(physicalDeviceProperties.physicalDeviceFeatures.pipelineStatisticsQuery) {
+                frame.statisticsQueryPool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+                        /*flags*/              {},
+                        /*queryType*/          vk::QueryType::ePipelineStatistics,
+                        /*queryCount*/         FrameStatistics::PASS_COUNT,
+                        /*pipelineStatistics*/ pipelineStatisticFlags
+                });
+            }
+        }
+
+
+        vk::DescriptorPoolSize descriptorPoolSizes[] {
+                {
+                        /*type*/            vk::DescriptorType::eUniformBuffer,
+                        /*descriptorCount*/ (uint32_t) frames.size() * 2
+                },
+                {
+                        /*type*/            vk::DescriptorType::eStorageBuffer,
+                        /*descriptorCount*/ (uint32_t) frames.size() * 2
+                }
+        };
+        descriptorPool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
+                /*flags*/         {},
+                /*maxSets*/       (uint32_t) frames.size() * 2,
+                /*poolSizeCount*/ 2,
+                /*pPoolSizes*/    descriptorPoolSizes
+        });
+        for(Frame& frame : frames) {
+            frame.descriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
+                    /*descriptorPool*/     *descriptorPool,
+                    /*descriptorSetCount*/ 1,
+                    /*pSetLayouts*/        &*deviceContext->descriptorSetLayout
+            }).front();
+            frame.cullDescriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
+                    /*descriptorPool*/     *descriptorPool,
+                    /*descriptorSetCount*/ 1,
+                    /*pSetLayouts*/        &*deviceContext->cullDescriptorSetLayout
+            }).front();
+            frame.uniformBuffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
+                    /*flags*/                 {},
+                    /*size*/                  sizeof(Uniform),
+                    /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer,
+                    /*sharingMode*/           vk::SharingMode::eExclusive,
+                    /*queueFamilyIndexCount*/ 0,
+                    /*pQueueFamilyIndices*/   nullptr
+            });
+            vk::DescriptorBufferInfo descriptorBufferInfo{
+                    /*buffer*/ *frame.uniformBuffer,
+                    /*offset*/ 0,
+                    /*range*/  VK_WHOLE_SIZE
+            };
+            device.updateDescriptorSets({
+                vk::WriteDescriptorSet{
+                    /*dstSet*/           frame.descriptorSet,
+                    /*dstBinding*/       0,
+                    /*dstArrayElement*/  0,
+                    /*descriptorCount*/  1,
+                    /*descriptorType*/   vk::DescriptorType::eUniformBuffer,
+                    /*pImageInfo*/       nullptr,
+                    /*pBufferInfo*/      &descriptorBufferInfo,
+                    /*pTexelBufferView*/ nullptr
+                },
+                vk::WriteDescriptorSet{
+                    /*dstSet*/           frame.cullDescriptorSet,
+                    /*dstBinding*/       0,
+                    /*dstArrayElement*/  0,
+                    /*descriptorCount*/  1,
+                    /*descriptorType*/   vk::DescriptorType::eUniformBuffer,
+                    /*pImageInfo*/       nullptr,
+                    /*pBufferInfo*/      &descriptorBufferInfo,
+                    /*pTexelBufferView*/ nullptr
+                }
+            }, {});
+
+
+            frame.triangleDrawIndirectBuffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
+                    /*flags*/                 {},
+                    /*size*/                  sizeof(vk::DrawIndexedIndirectCommand),
+                    /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer,
+                    /*sharingMode*/           vk::SharingMode::eExclusive,
+                    /*queueFamilyIndexCount*/ 0,
+                    /*pQueueFamilyIndices*/   nullptr
+            });
+
+            frame.polygonDrawIndirectBuffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
+                    /*flags*/                 {},
+                    /*size*/                  sizeof(vk::DrawIndexedIndirectCommand),
+                    /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer,
+                    /*sharingMode*/           vk::SharingMode::eExclusive,
+                    /*queueFamilyIndexCount*/ 0,
+                    /*pQueueFamilyIndices*/   nullptr
+            });
+
+            frame.vertexMarkerDrawIndirectBuffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
+                    /*flags*/                 {},
+                    /*size*/                  sizeof(vk::DrawIndirectCommand),
+                    /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer,
+                    /*sharingMode*/           vk::SharingMode::eExclusive,
+                    /*queueFamilyIndexCount*/ 0,
+                    /*pQueueFamilyIndices*/   nullptr
+            });
+        }
+
+    }
+
+
+
+    /** Objects shared by all renderers of the device, created under pipeline mutex */
+    void createSharedPipelineObjects(DeviceContext& context) {
+        vk::DescriptorSetLayoutBinding descriptorSetLayoutBinding {
+                /*binding*/            0,
+                /*descriptorType*/     vk::DescriptorType::eUniformBuffer,
+                /*descriptorCount*/    1,
+                /*stageFlags*/         vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute,
+                /*pImmutableSamplers*/ nullptr
+        };
+        context.descriptorSetLayout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{
+                /*flags*/        {},
+                /*bindingCount*/ 1,
+                /*pBindings*/    &descriptorSetLayoutBinding
+        });
 
-        commandPool = device->createCommandPoolUnique(vk::CommandPoolCreateInfo{
-                /*flags*/            {},
-                /*queueFamilyIndex*/ queueFamily
+        vk::PushConstantRange pushConstantRange{
+                /*stageFlags*/ vk::ShaderStageFlagBits::eVertex,
+                /*offset*/     0,
+                /*size*/       sizeof(float)
+        };
+        context.pipelineLayout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
+                /*flags*/                  {},
+                /*setLayoutCount*/         1,
+                /*pSetLayouts*/            &*context.descriptorSetLayout,
+                /*pushConstantRangeCount*/ 1,
+                /*pPushConstantRanges*/    &pushConstantRange
         });
 
+        context.pipelineCache = PipelineCacheStorage::load(device, physicalDeviceProperties.physicalDeviceProperties, context.pipelineCacheWarm);
 
+        context.vertexShader = loadShader(device, resource::shader::main_vert);
+        context.triangleFragmentShader = loadShader(device, resource::shader::triangle_frag);
+        context.flatFragmentShader = loadShader(device, resource::shader::flat_frag);
+        context.vertexMarkerVertexShader = loadShader(device, resource::shader::vertex_marker_vert);
+        context.vertexMarkerFragmentShader = loadShader(device, resource::shader::vertex_marker_frag);
+
+
+        vk::DescriptorSetLayoutBinding cullDescriptorSetLayoutBindings[] {
+                {
+                        /*binding*/            0,
+                        /*descriptorType*/     vk::DescriptorType::eUniformBuffer,
+                        /*descriptorCount*/    1,
+                        /*stageFlags*/         vk::ShaderStageFlagBits::eCompute,
+                        /*pImmutableSamplers*/ nullptr
+                },
+                {
+                        /*binding*/            1,
+                        /*descriptorType*/     vk::DescriptorType::eStorageBuffer,
+                        /*descriptorCount*/    1,
+                        /*stageFlags*/         vk::ShaderStageFlagBits::eCompute,
+                        /*pImmutableSamplers*/ nullptr
+                },
+                {
+                        /*binding*/            2,
+                        /*descriptorType*/     vk::DescriptorType::eStorageBuffer,
+                        /*descriptorCount*/    1,
+                        /*stageFlags*/         vk::ShaderStageFlagBits::eCompute,
+                        /*pImmutableSamplers*/ nullptr
+                }
+        };
+        context.cullDescriptorSetLayout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{
+                /*flags*/        {},
+                /*bindingCount*/ 3,
+                /*pBindings*/    cullDescriptorSetLayoutBindings
+        });
+        vk::PushConstantRange cullPushConstantRange{
+                /*stageFlags*/ vk::ShaderStageFlagBits::eCompute,
+                /*offset*/     0,
+                /*size*/       sizeof(uint32_t) * 2
+        };
+        context.cullPipelineLayout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
+                /*flags*/                  {},
+                /*setLayoutCount*/         1,
+                /*pSetLayouts*/            &*context.cullDescriptorSetLayout,
+                /*pushConstantRangeCount*/ 1,
+                /*pPushConstantRanges*/    &cullPushConstantRange
+        });
+        context.cullShader = loadShader(device, resource::shader::cull_comp);
+        context.cullPipeline = device.createComputePipelineUnique(*context.pipelineCache, vk::ComputePipelineCreateInfo{
+                /*flags*/              {},
+                /*stage*/              vk::PipelineShaderStageCreateInfo{
+                        /*flags*/               {},
+                        /*stage*/               vk::ShaderStageFlagBits::eCompute,
+                        /*module*/              *context.cullShader,
+                        /*pName*/               "main",
+                        /*pSpecializationInfo*/ nullptr
+                },
+                /*layout*/             *context.cullPipelineLayout,
+                /*basePipelineHandle*/ {},
+                /*basePipelineIndex*/  -1
+        });
+        PipelineCacheStorage::store(device, *context.pipelineCache, physicalDeviceProperties.physicalDeviceProperties);
+    }
+
+    /** Without multisampling, target image is drawn into directly and there is nothing to resolve */
+    void createRenderPass() {
+        bool multisampled = graphicSettings.sampleCount != vk::SampleCountFlagBits::e1;
         vk::AttachmentDescription renderPassAttachmentDescriptions[] {
                 {
                         /*flags*/          {},
@@ -96,9 +550,13 @@ public:
                         /*stencilLoadOp*/  vk::AttachmentLoadOp::eDontCare,
                         /*stencilStoreOp*/ vk::AttachmentStoreOp::eDontCare,
                         /*initialLayout*/  vk::ImageLayout::eUndefined,
-                        /*finalLayout*/    vk::ImageLayout::ePresentSrcKHR
+                        /*finalLayout*/    offscreen ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR
                 }
         };
+        if(!multisampled) {
+            renderPassAttachmentDescriptions[0] = renderPassAttachmentDescriptions[1];
+            renderPassAttachmentDescriptions[0].loadOp = vk::AttachmentLoadOp::eClear;
+        }
         vk::AttachmentReference renderPassAttachmentReferences[] {
                 {
                         /*attachment*/ 0,
@@ -116,65 +574,76 @@ public:
                 /*pInputAttachments*/       nullptr,
                 /*colorAttachmentCount*/    1,
                 /*pColorAttachments*/       renderPassAttachmentReferences,
-                /*pResolveAttachments*/     renderPassAttachmentReferences + 1,
+                /*pResolveAttachments*/     multisampled ? renderPassAttachmentReferences + 1 : nullptr,
                 /*pDepthStencilAttachment*/ nullptr,
                 /*preserveAttachmentCount*/ 0,
                 /*pPreserveAttachments*/    nullptr
         };
-        renderPass = device->createRenderPassUnique(vk::RenderPassCreateInfo{
+        // Multisampled image is shared between frames in flight, so rendering must wait for previous frame's writes
+        // Offscreen image is copied into readback buffer right after rendering
+        vk::SubpassDependency renderPassSubpassDependencies[] {
+                {
+                        /*srcSubpass*/      VK_SUBPASS_EXTERNAL,
+                        /*dstSubpass*/      0,
+                        /*srcStageMask*/    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                        /*dstStageMask*/    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                        /*srcAccessMask*/   vk::AccessFlagBits::eColorAttachmentWrite,
+                        /*dstAccessMask*/   vk::AccessFlagBits::eColorAttachmentWrite,
+                        /*dependencyFlags*/ {}
+                },
+                {
+                        /*srcSubpass*/      0,
+                        /*dstSubpass*/      VK_SUBPASS_EXTERNAL,
+                        /*srcStageMask*/    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                        /*dstStageMask*/    vk::PipelineStageFlagBits::eTransfer,
+                        /*srcAccessMask*/   vk::AccessFlagBits::eColorAttachmentWrite,
+                        /*dstAccessMask*/   vk::AccessFlagBits::eTransferRead,
+                        /*dependencyFlags*/ {}
+                }
+        };
+        renderPass = device.createRenderPassUnique(vk::RenderPassCreateInfo{
                 /*flags*/           {},
-                /*attachmentCount*/ 2,
+                /*attachmentCount*/ multisampled ? 2U : 1U,
                 /*pAttachments*/    renderPassAttachmentDescriptions,
                 /*subpassCount*/    1,
                 /*pSubpasses*/      &renderPassSubpassDescription,
-                /*dependencyCount*/ 0,
-                /*pDependencies*/   nullptr
-        });
-
-        vk::DescriptorSetLayoutBinding descriptorSetLayoutBinding {
-                /*binding*/            0,
-                /*descriptorType*/     vk::DescriptorType::eUniformBuffer,
-                /*descriptorCount*/    1,
-                /*stageFlags*/         vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eGeometry,
-                /*pImmutableSamplers*/ nullptr
-        };
-        descriptorSetLayout = device->createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{
-                /*flags*/        {},
-                /*bindingCount*/ 1,
-                /*pBindings*/    &descriptorSetLayoutBinding
-        });
-
-        pipelineLayout = device->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
-                /*flags*/                  {},
-                /*setLayoutCount*/         1,
-                /*pSetLayouts*/            &*descriptorSetLayout,
-                /*pushConstantRangeCount*/ 0,
-                /*pPushConstantRanges*/    nullptr
+                /*dependencyCount*/ offscreen ? 2U : 1U,
+                /*pDependencies*/   renderPassSubpassDependencies
         });
+    }
 
-        vertexShader = loadShader(*device, resource::shader::main_vert);
-        triangleFragmentShader = loadShader(*device, resource::shader::triangle_frag);
-        flatFragmentShader = loadShader(*device, resource::shader::flat_frag);
-        triangleVertexGeometryShader = loadShader(*device, resource::shader::triangle_vertex_geom);
-
-
+    /** Graphics pipelines depend on image format and sample count of render pass, so they are shared by renderers
+     * with the same ones. Compute pipeline doesn't depend on them.
+     */
+    void createGraphicsPipelines() {
+        DeviceContext& context = *deviceContext;
+        std::lock_guard<std::mutex> lock(context.pipelineMutex);
+        auto key = std::make_pair(graphicSettings.imageFormat, graphicSettings.sampleCount);
+        auto existing = context.graphicsPipelines.find(key);
+        if(existing != context.graphicsPipelines.end()) {
+            pipelines = existing->second;
+            return;
+        }
+#if !defined(NDEBUG)
+        auto createStart = std::chrono::steady_clock::now();
+#endif
+        auto newPipelines = std::make_shared<DeviceContext::GraphicsPipelines>();
 
         vk::PipelineShaderStageCreateInfo stageCreateInfos[] {
                 vk::PipelineShaderStageCreateInfo{
                         /*flags*/               {},
                         /*stage*/               vk::ShaderStageFlagBits::eVertex,
-                        /*module*/              *vertexShader,
+                        /*module*/              *context.vertexShader,
                         /*pName*/               "main",
                         /*pSpecializationInfo*/ nullptr
                 },
                 vk::PipelineShaderStageCreateInfo{
                         /*flags*/               {},
                         /*stage*/               vk::ShaderStageFlagBits::eFragment,
-                        /*module*/              *triangleFragmentShader,
+                        /*module*/              *context.triangleFragmentShader,
                         /*pName*/               "main",
                         /*pSpecializationInfo*/ nullptr
-                },
-                {}
+                }
         };
 
 
@@ -297,7 +766,7 @@ public:
                 /*pDepthStencilState*/  &depthStencilStateCreateInfo,
                 /*pColorBlendState*/    &colorBlendStateCreateInfo,
                 /*pDynamicState*/       &dynamicStateCreateInfo,
-                /*layout*/              *pipelineLayout,
+                /*layout*/              *context.pipelineLayout,
                 /*renderPass*/          *renderPass,
                 /*subpass*/             0,
                 /*basePipelineHandle*/  {},
@@ -305,7 +774,7 @@ public:
         };
 
 
-        trianglePipeline = device->createGraphicsPipelineUnique({}, pipelineCreateInfo);
+        newPipelines->triangle = device.createGraphicsPipelineUnique(*context.pipelineCache, pipelineCreateInfo);
 
 
         vk::SpecializationMapEntry specializationMapEntries[] {{
@@ -331,185 +800,345 @@ public:
         stageCreateInfos[1] = vk::PipelineShaderStageCreateInfo{
                 /*flags*/               {},
                 /*stage*/               vk::ShaderStageFlagBits::eFragment,
-                /*module*/              *flatFragmentShader,
+                /*module*/              *context.flatFragmentShader,
                 /*pName*/               "main",
                 /*pSpecializationInfo*/ &specializationInfo
         };
         rasterizationStateCreateInfo.polygonMode = vk::PolygonMode::eLine;
-        triangleEdgePipeline = device->createGraphicsPipelineUnique({}, pipelineCreateInfo);
+        newPipelines->triangleEdge = device.createGraphicsPipelineUnique(*context.pipelineCache, pipelineCreateInfo);
 
 
         flatColor = {0.1, 0.1, 0.1};
         stageCreateInfos[1] = vk::PipelineShaderStageCreateInfo{
                 /*flags*/               {},
                 /*stage*/               vk::ShaderStageFlagBits::eFragment,
-                /*module*/              *flatFragmentShader,
+                /*module*/              *context.flatFragmentShader,
                 /*pName*/               "main",
                 /*pSpecializationInfo*/ &specializationInfo
         };
         rasterizationStateCreateInfo.lineWidth = 3;
-        inputAssemblyStateCreateInfo.topology = vk::PrimitiveTopology::eLineList;
-        polygonEdgePipeline = device->createGraphicsPipelineUnique({}, pipelineCreateInfo);
+        // Each polygon outline is a closed line strip, separated from the next one by restart index
+        inputAssemblyStateCreateInfo.topology = vk::PrimitiveTopology::eLineStrip;
+        inputAssemblyStateCreateInfo.primitiveRestartEnable = true;
+        newPipelines->polygonEdge = device.createGraphicsPipelineUnique(*context.pipelineCache, pipelineCreateInfo);
+        inputAssemblyStateCreateInfo.primitiveRestartEnable = false;
 
 
+        // Vertex markers are instanced quads, one per polygon vertex, with circle drawn by fragment shader
         rasterizationStateCreateInfo.polygonMode = vk::PolygonMode::eFill;
         rasterizationStateCreateInfo.lineWidth = 1;
-        stageCreateInfos[1] = vk::PipelineShaderStageCreateInfo{
+        inputAssemblyStateCreateInfo.topology = vk::PrimitiveTopology::eTriangleStrip;
+        vertexInputBindingDescription.inputRate = vk::VertexInputRate::eInstance;
+        colorBlendAttachmentState.blendEnable = true;
+        colorBlendAttachmentState.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+        colorBlendAttachmentState.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+        colorBlendAttachmentState.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+        colorBlendAttachmentState.dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+        stageCreateInfos[0] = vk::PipelineShaderStageCreateInfo{
                 /*flags*/               {},
-                /*stage*/               vk::ShaderStageFlagBits::eGeometry,
-                /*module*/              *triangleVertexGeometryShader,
+                /*stage*/               vk::ShaderStageFlagBits::eVertex,
+                /*module*/              *context.vertexMarkerVertexShader,
                 /*pName*/               "main",
                 /*pSpecializationInfo*/ nullptr
         };
-        stageCreateInfos[2] = vk::PipelineShaderStageCreateInfo{
+        stageCreateInfos[1] = vk::PipelineShaderStageCreateInfo{
                 /*flags*/               {},
                 /*stage*/               vk::ShaderStageFlagBits::eFragment,
-                /*module*/              *flatFragmentShader,
+                /*module*/              *context.vertexMarkerFragmentShader,
                 /*pName*/               "main",
                 /*pSpecializationInfo*/ &specializationInfo
         };
-        pipelineCreateInfo.stageCount = 3;
-        polygonVertexPipeline = device->createGraphicsPipelineUnique({}, pipelineCreateInfo);
-
-
-
-
-
-        vk::DescriptorPoolSize descriptorPoolSize{
-                /*type*/            vk::DescriptorType::eUniformBuffer,
-                /*descriptorCount*/ 1
-        };
-        descriptorPool = device->createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
-                /*flags*/         {},
-                /*maxSets*/       1,
-                /*poolSizeCount*/ 1,
-                /*pPoolSizes*/    &descriptorPoolSize
-        });
-        descriptorSet = device->allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
-                /*descriptorPool*/     *descriptorPool,
-                /*descriptorSetCount*/ 1,
-                /*pSetLayouts*/        &*descriptorSetLayout
-        }).front();
-        uniformBuffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
-                /*flags*/                 {},
-                /*size*/                  8,
-                /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer,
-                /*sharingMode*/           vk::SharingMode::eExclusive,
-                /*queueFamilyIndexCount*/ 0,
-                /*pQueueFamilyIndices*/   nullptr
-        });
-        vk::DescriptorBufferInfo descriptorBufferInfo{
-                /*buffer*/ *uniformBuffer,
-                /*offset*/ 0,
-                /*range*/  VK_WHOLE_SIZE
-        };
-        device->updateDescriptorSets({
-            vk::WriteDescriptorSet{
-                /*dstSet*/           descriptorSet,
-                /*dstBinding*/       0,
-                /*dstArrayElement*/  0,
-                /*descriptorCount*/  1,
-                /*descriptorType*/   vk::DescriptorType::eUniformBuffer,
-                /*pImageInfo*/       nullptr,
-                /*pBufferInfo*/      &descriptorBufferInfo,
-                /*pTexelBufferView*/ nullptr
-            }
-        }, {});
-
-
-        triangleDrawIndirectBuffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
-                /*flags*/                 {},
-                /*size*/                  sizeof(vk::DrawIndexedIndirectCommand),
-                /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer,
-                /*sharingMode*/           vk::SharingMode::eExclusive,
-                /*queueFamilyIndexCount*/ 0,
-                /*pQueueFamilyIndices*/   nullptr
-        });
-
-        polygonDrawIndirectBuffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
-                /*flags*/                 {},
-                /*size*/                  sizeof(vk::DrawIndirectCommand),
-                /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer,
-                /*sharingMode*/           vk::SharingMode::eExclusive,
-                /*queueFamilyIndexCount*/ 0,
-                /*pQueueFamilyIndices*/   nullptr
-        });
-
+        newPipelines->vertexMarker = device.createGraphicsPipelineUnique(*context.pipelineCache, pipelineCreateInfo);
+
+#if !defined(NDEBUG)
+        // Compare with a cold run by removing cache file or pointing DECOMPOSITION_VIEWER_CACHE_DIR to an empty directory
+        std::cerr << "Graphics pipelines created in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - createStart).count()
+                  << " ms with " << (context.pipelineCacheWarm ? "warm" : "cold") << " pipeline cache" << std::endl;
+#endif
+        PipelineCacheStorage::store(device, *context.pipelineCache, physicalDeviceProperties.physicalDeviceProperties);
+        context.graphicsPipelines[key] = newPipelines;
+        pipelines = std::move(newPipelines);
     }
 
 
 
-    void recordCommandBuffers() {
-        device->resetCommandPool(*commandPool, {});
-        for (uint32_t i = 0; i < swapchain.images.size(); i++) {
-            vk::CommandBuffer commandBuffer = swapchainContext.commandBuffers[i];
+    /** Every pass draws all images of the frame, each into its own part of framebuffer, so that passes are measured as a whole */
+    void recordCommandBuffers(Frame& frame) {
+        device.resetCommandPool(*frame.commandPool, {});
+        frame.recordedPolygonVerticesOffset = frame.polygonVerticesOffset;
+        uint32_t imageCount = std::max(frame.batchImageCount, 1U);
+        for (uint32_t i = 0; i < frame.commandBuffers.size(); i++) {
+            vk::CommandBuffer commandBuffer = frame.commandBuffers[i];
+            uint32_t target = offscreen ? (uint32_t) (&frame - frames.data()) : i;
             commandBuffer.begin(vk::CommandBufferBeginInfo{
                     /*flags*/            {},
                     /*pInheritanceInfo*/ nullptr
             });
+            bool profile = measuring() && frame.timestampQueryPool;
+            bool pipelineStatistics = profile && profiling && frame.statisticsQueryPool;
+            if(profile) {
+                commandBuffer.resetQueryPool(*frame.timestampQueryPool, 0, FrameStatistics::PASS_COUNT + 1);
+                if(pipelineStatistics) commandBuffer.resetQueryPool(*frame.statisticsQueryPool, 0, FrameStatistics::PASS_COUNT);
+                commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *frame.timestampQueryPool, 0);
+            }
+            // Every pass is enclosed in pipeline statistics query and followed by timestamp, even when it draws nothing
+            auto beginPass = [&](FrameStatistics::Pass pass) {
+                if(pipelineStatistics) commandBuffer.beginQuery(*frame.statisticsQueryPool, pass, {});
+            };
+            auto endPass = [&](FrameStatistics::Pass pass) {
+                if(!profile) return;
+                if(pipelineStatistics) commandBuffer.endQuery(*frame.statisticsQueryPool, pass);
+                commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *frame.timestampQueryPool, pass + 1);
+            };
+            bool culling = frame.culling && frame.drawBuffer;
+            beginPass(FrameStatistics::CULL);
+            if(culling) {
+                // With draw counts, draws past the visible ones are never read, so only counters are cleared
+                commandBuffer.fillBuffer(*frame.drawBuffer, 0, drawIndirectCount ? cullDrawsOffset : VK_WHOLE_SIZE, 0);
+                commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {},
+                        vk::MemoryBarrier{
+                                /*srcAccessMask*/ vk::AccessFlagBits::eTransferWrite,
+                                /*dstAccessMask*/ vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+                        }, nullptr, nullptr);
+                uint32_t chunkCapacities[] {frame.triangleChunkCapacity, frame.polygonChunkCapacity};
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *deviceContext->cullPipeline);
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *deviceContext->cullPipelineLayout, 0, frame.cullDescriptorSet, {});
+                commandBuffer.pushConstants(*deviceContext->cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(chunkCapacities), chunkCapacities);
+                commandBuffer.dispatch((frame.triangleChunkCapacity + frame.polygonChunkCapacity + 63) / 64, 1, 1);
+                commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {},
+                        vk::MemoryBarrier{
+                                /*srcAccessMask*/ vk::AccessFlagBits::eShaderWrite,
+                                /*dstAccessMask*/ vk::AccessFlagBits::eIndirectCommandRead
+                        }, nullptr, nullptr);
+            }
+            endPass(FrameStatistics::CULL);
+            auto drawCulled = [&](vk::DeviceSize offset, uint32_t stream, uint32_t capacity) {
+                if(drawIndirectCount) commandBuffer.drawIndexedIndirectCountKHR(*frame.drawBuffer, offset,
+                        *frame.drawBuffer, stream * sizeof(uint32_t), capacity, sizeof(vk::DrawIndexedIndirectCommand));
+                else commandBuffer.drawIndexedIndirect(*frame.drawBuffer, offset, capacity, sizeof(vk::DrawIndexedIndirectCommand));
+            };
+            // Images of a batch are drawn one below another, each with its own viewport and draw arguments
+            auto selectImage = [&](uint32_t image) {
+                auto y = (int32_t) (image * targetContext.extent.height);
+                commandBuffer.setViewport(0, vk::Viewport{
+                        /*x*/        0,
+                        /*y*/        (float) y,
+                        /*width*/    (float) targetContext.extent.width,
+                        /*height*/   (float) targetContext.extent.height,
+                        /*minDepth*/ 0,
+                        /*maxDepth*/ 1
+                });
+                commandBuffer.setScissor(0, vk::Rect2D{{0, y}, targetContext.extent});
+            };
+            auto drawTriangles = [&](uint32_t image) {
+                if(culling) drawCulled(cullDrawsOffset, 0, frame.triangleChunkCapacity);
+                else commandBuffer.drawIndexedIndirect(*frame.triangleDrawIndirectBuffer, image * sizeof(vk::DrawIndexedIndirectCommand), 1, 0);
+            };
+            auto drawPolygons = [&](uint32_t image) {
+                if(culling) drawCulled(cullDrawsOffset + frame.triangleChunkCapacity * sizeof(vk::DrawIndexedIndirectCommand), 1, frame.polygonChunkCapacity);
+                else commandBuffer.drawIndexedIndirect(*frame.polygonDrawIndirectBuffer, image * sizeof(vk::DrawIndexedIndirectCommand), 1, 0);
+            };
             vk::ClearValue clearColor {vk::ClearColorValue {std::array<float, 4> {1.0F, 1.0F, 1.0F, 1.0F}}};
             commandBuffer.beginRenderPass(vk::RenderPassBeginInfo{
                     /*renderPass*/      *renderPass,
-                    /*framebuffer*/     *swapchainContext.framebuffers[i],
-                    /*renderArea*/      {{0, 0}, swapchain.extent},
+                    /*framebuffer*/     *targetContext.framebuffers[target],
+                    /*renderArea*/      {{0, 0}, targetContext.framebufferExtent},
                     /*clearValueCount*/ 1,
                     /*pClearValues*/    &clearColor
             }, vk::SubpassContents::eInline);
-            commandBuffer.setViewport(0, vk::Viewport{
-                    /*x*/        0,
-                    /*y*/        0,
-                    /*width*/    (float) swapchain.extent.width,
-                    /*height*/   (float) swapchain.extent.height,
-                    /*minDepth*/ 0,
-                    /*maxDepth*/ 1
-            });
-            commandBuffer.setScissor(0, vk::Rect2D{{0, 0}, swapchain.extent});
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, descriptorSet, {});
-            if(vertexBuffer) {
-                commandBuffer.bindVertexBuffers(0, {*vertexBuffer}, {0});
-                if(triangleIndexBuffer) {
-                    commandBuffer.bindIndexBuffer(*triangleIndexBuffer, 0, vk::IndexType::eUint32);
-                    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *trianglePipeline);
-                    commandBuffer.drawIndexedIndirect(*triangleDrawIndirectBuffer, 0, 1, 0);
+            selectImage(0);
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *deviceContext->pipelineLayout, 0, frame.descriptorSet, {});
+            bool geometry = frame.geometryBuffer;
+            if(geometry) {
+                commandBuffer.bindVertexBuffers(0, {*frame.geometryBuffer}, {0});
+                commandBuffer.bindIndexBuffer(*frame.geometryBuffer, 0, vk::IndexType::eUint32);
+            }
+            beginPass(FrameStatistics::TRIANGLES);
+            if(geometry) {
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipelines->triangle);
+                for(uint32_t image = 0; image < imageCount; image++) {
+                    if(imageCount != 1) selectImage(image);
+                    drawTriangles(image);
                 }
             }
-            if(polygonVerticesBuffer) {
-                commandBuffer.bindVertexBuffers(0, {*polygonVerticesBuffer}, {0});
-                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *polygonEdgePipeline);
-                commandBuffer.drawIndirect(*polygonDrawIndirectBuffer, 0, 1, 0);
-                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *polygonVertexPipeline);
-                commandBuffer.drawIndirect(*polygonDrawIndirectBuffer, 0, 1, 0);
+            endPass(FrameStatistics::TRIANGLES);
+            beginPass(FrameStatistics::POLYGON_EDGES);
+            if(geometry) {
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipelines->polygonEdge);
+                for(uint32_t image = 0; image < imageCount; image++) {
+                    if(imageCount != 1) selectImage(image);
+                    drawPolygons(image);
+                }
             }
-            if(vertexBuffer && triangleIndexBuffer) {
-                commandBuffer.bindVertexBuffers(0, {*vertexBuffer}, {0});
-                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *triangleEdgePipeline);
-                commandBuffer.drawIndexedIndirect(*triangleDrawIndirectBuffer, 0, 1, 0);
+            endPass(FrameStatistics::POLYGON_EDGES);
+            beginPass(FrameStatistics::VERTEX_MARKERS);
+            if(geometry) {
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipelines->vertexMarker);
+                commandBuffer.pushConstants(*deviceContext->pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(float), &vertexMarkerRadius);
+                for(uint32_t image = 0; image < imageCount; image++) {
+                    if(imageCount != 1) selectImage(image);
+                    // Without drawIndirectFirstInstance, instances are addressed by binding offset instead
+                    if(!drawIndirectFirstInstance) {
+                        vk::DeviceSize polygonVerticesOffset = frame.batchImageCount == 0 ? frame.polygonVerticesOffset : frame.batchPolygonVerticesOffsets[image];
+                        commandBuffer.bindVertexBuffers(0, {*frame.geometryBuffer}, {polygonVerticesOffset});
+                    }
+                    commandBuffer.drawIndirect(*frame.vertexMarkerDrawIndirectBuffer, image * sizeof(vk::DrawIndirectCommand), 1, 0);
+                }
+                if(!drawIndirectFirstInstance) commandBuffer.bindVertexBuffers(0, {*frame.geometryBuffer}, {0});
+            }
+            endPass(FrameStatistics::VERTEX_MARKERS);
+            beginPass(FrameStatistics::TRIANGLE_EDGES);
+            if(geometry) {
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipelines->triangleEdge);
+                for(uint32_t image = 0; image < imageCount; image++) {
+                    if(imageCount != 1) selectImage(image);
+                    drawTriangles(image);
+                }
             }
+            endPass(FrameStatistics::TRIANGLE_EDGES);
             commandBuffer.endRenderPass();
+            if(offscreen) {
+                // Images are copied one after another, so readback buffer holds them tightly packed
+                std::vector<vk::BufferImageCopy> regions;
+                for(uint32_t image = 0; image < imageCount; image++) {
+                    regions.push_back(vk::BufferImageCopy{
+                            /*bufferOffset*/      (vk::DeviceSize) image * targetContext.extent.width * targetContext.extent.height * 4,
+                            /*bufferRowLength*/   0,
+                            /*bufferImageHeight*/ 0,
+                            /*imageSubresource*/  vk::ImageSubresourceLayers{
+                                    /*aspectMask*/     vk::ImageAspectFlagBits::eColor,
+                                    /*mipLevel*/       0,
+                                    /*baseArrayLayer*/ 0,
+                                    /*layerCount*/     1
+                            },
+                            /*imageOffset*/       {0, (int32_t) (image * targetContext.extent.height), 0},
+                            /*imageExtent*/       vk::Extent3D(targetContext.extent, 1)
+                    });
+                }
+                commandBuffer.copyImageToBuffer(*targetContext.offscreenImages[target], vk::ImageLayout::eTransferSrcOptimal,
+                        *frame.readbackBuffer, regions);
+                commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {},
+                        vk::MemoryBarrier{
+                                /*srcAccessMask*/ vk::AccessFlagBits::eTransferWrite,
+                                /*dstAccessMask*/ vk::AccessFlagBits::eHostRead
+                        }, nullptr, nullptr);
+            }
             commandBuffer.end();
         }
     }
 
 
 
+    /** Recreates swapchain for current surface size. Doesn't wait for frames in flight, their command buffers
+     * are recorded again when they are reused, and old swapchain is destroyed once they are complete.
+     */
     void updateSwapchainContext() {
-        device->waitForFences({*renderingCompleteFence}, true, -1);
+        vk::Extent2D surfaceExtent = physicalDeviceProperties.getSurfaceCapabilities().currentExtent;
+        if(surfaceExtent.width == 0 || surfaceExtent.height == 0) {
+            // Minimized window, there is nothing to render into until it's restored
+            swapchainOutOfDate = true;
+            return;
+        }
 
-        swapchainContext = {};
-        Swapchain newSwapchain = Swapchain::create(*this, swapchain);
-        swapchain = std::move(newSwapchain);
+        RetiredTarget retired {submittedSerial, std::move(swapchain), std::move(targetContext)};
+        swapchain = Swapchain::create(*this, retired.swapchain);
+        targetContext = {};
+        targetContext.extent = targetContext.framebufferExtent = swapchain.extent;
+        createMultisampledImage(retired.targetContext);
+        createFramebuffers();
+
+        for(Frame& frame : frames) frame.targetOutdated = true;
+        retiredTargets.push_back(std::move(retired));
+        releaseRetiredTargets();
+        swapchainOutOfDate = false;
+    }
+
+    void releaseRetiredTargets() {
+        while(!retiredTargets.empty() && retiredTargets.front().serial <= completedSerial) retiredTargets.pop_front();
+    }
 
-        swapchainContext.image = vma::UnmappedImage(*device, vma,
+    /** Allocates command buffer for each swapchain image, or just one drawing into frame's own offscreen image.
+     * Frame must not be in flight.
+     */
+    void allocateCommandBuffers(Frame& frame) {
+        if(!frame.commandBuffers.empty()) device.freeCommandBuffers(*frame.commandPool, frame.commandBuffers);
+        frame.commandBuffers.clear();
+        if(!targetContext.framebuffers.empty()) {
+            frame.commandBuffers = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{
+                    /*commandPool*/        *frame.commandPool,
+                    /*level*/              vk::CommandBufferLevel::ePrimary,
+                    /*commandBufferCount*/ offscreen ? 1U : (uint32_t) targetContext.framebuffers.size()
+            });
+        }
+        frame.targetOutdated = false;
+    }
+
+    /** Creates offscreen image, readback buffer and draw arguments for a batch of images for every frame in flight.
+     * Batch is as large as image dimension limits allow, up to maxOffscreenBatch images and maxOffscreenBatchBytes of pixels.
+     */
+    void updateOffscreenContext(vk::Extent2D extent) {
+        for(Frame& frame : frames) device.waitForFences({*frame.renderingCompleteFence}, true, -1);
+
+        const vk::PhysicalDeviceLimits& limits = physicalDeviceProperties.physicalDeviceProperties.limits;
+        vk::DeviceSize imageSize = (vk::DeviceSize) extent.width * extent.height * 4;
+        vk::DeviceSize batch = std::min<vk::DeviceSize>(std::min(limits.maxImageDimension2D, limits.maxFramebufferHeight) / std::max(extent.height, 1U),
+                                                        maxOffscreenBatchBytes / std::max<vk::DeviceSize>(imageSize, 1));
+        offscreenBatch = (uint32_t) std::clamp<vk::DeviceSize>(batch, 1, maxOffscreenBatch);
+
+        TargetContext previous = std::move(targetContext);
+        targetContext = {};
+        targetContext.extent = extent;
+        targetContext.framebufferExtent = vk::Extent2D{extent.width, extent.height * offscreenBatch};
+        createMultisampledImage(previous);
+
+        for(Frame& frame : frames) {
+            targetContext.offscreenImages.push_back(createImage(targetContext.framebufferExtent, graphicSettings.imageUsage, vk::SampleCountFlagBits::e1));
+
+            frame.readbackBuffer = {};
+            frame.readbackBuffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
+                    /*flags*/                 {},
+                    /*size*/                  imageSize * offscreenBatch,
+                    /*usage*/                 vk::BufferUsageFlagBits::eTransferDst,
+                    /*sharingMode*/           vk::SharingMode::eExclusive,
+                    /*queueFamilyIndexCount*/ 0,
+                    /*pQueueFamilyIndices*/   nullptr
+            }, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+            auto createDrawIndirectBuffer = [&](vk::DeviceSize commandSize) {
+                return vma::StreamBuffer(vma, vk::BufferCreateInfo{
+                        /*flags*/                 {},
+                        /*size*/                  commandSize * offscreenBatch,
+                        /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndirectBuffer,
+                        /*sharingMode*/           vk::SharingMode::eExclusive,
+                        /*queueFamilyIndexCount*/ 0,
+                        /*pQueueFamilyIndices*/   nullptr
+                });
+            };
+            frame.triangleDrawIndirectBuffer = createDrawIndirectBuffer(sizeof(vk::DrawIndexedIndirectCommand));
+            frame.polygonDrawIndirectBuffer = createDrawIndirectBuffer(sizeof(vk::DrawIndexedIndirectCommand));
+            frame.vertexMarkerDrawIndirectBuffer = createDrawIndirectBuffer(sizeof(vk::DrawIndirectCommand));
+            frame.batchImageCount = 0;
+        }
+        createFramebuffers();
+
+        for(Frame& frame : frames) {
+            allocateCommandBuffers(frame);
+            recordCommandBuffers(frame);
+        }
+    }
+
+    vma::UnmappedImage createImage(vk::Extent2D extent, vk::ImageUsageFlags usage, vk::SampleCountFlagBits samples) {
+        return vma::UnmappedImage(device, vma,
                 vk::ImageCreateInfo{
                         /*flags*/                 {},
                         /*imageType*/             vk::ImageType::e2D,
                         /*format*/                graphicSettings.imageFormat,
-                        /*extent*/                vk::Extent3D(swapchain.extent, 1),
+                        /*extent*/                vk::Extent3D(extent, 1),
                         /*mipLevels*/             1,
                         /*arrayLayers*/           1,
-                        /*samples*/               graphicSettings.sampleCount,
+                        /*samples*/               samples,
                         /*tiling*/                vk::ImageTiling::eOptimal,
-                        /*usage*/                 vk::ImageUsageFlagBits::eColorAttachment,
+                        /*usage*/                 usage,
                         /*sharingMode*/           vk::SharingMode::eExclusive,
                         /*queueFamilyIndexCount*/ 0,
                         /*pQueueFamilyIndices*/   nullptr,
@@ -530,40 +1159,132 @@ public:
                         }
                 }
         );
+    }
 
-        swapchainContext.framebuffers.reserve(swapchain.images.size());
-        for (size_t i = 0; i < swapchain.images.size(); i++) {
-            vk::ImageView views[] {swapchainContext.image.view, *swapchain.imageViews[i]};
-            swapchainContext.framebuffers.push_back(device->createFramebufferUnique(vk::FramebufferCreateInfo{
-                    /*flags*/           {},
-                    /*renderPass*/      *renderPass,
-                    /*attachmentCount*/ 2,
-                    /*pAttachments*/    views,
-                    /*width*/           swapchain.extent.width,
-                    /*height*/          swapchain.extent.height,
-                    /*layers*/          1
-            }));
-        }
-
-        device->freeCommandBuffers(*commandPool, swapchainContext.commandBuffers);
-        swapchainContext.commandBuffers = device->allocateCommandBuffers(vk::CommandBufferAllocateInfo{
-                /*commandPool*/        *commandPool,
-                /*level*/              vk::CommandBufferLevel::ePrimary,
-                /*commandBufferCount*/ (uint32_t) swapchain.images.size()
-        });
+    /** Multisampled image is allocated in buckets of this size, so that small resizes keep using the same image */
+    static constexpr uint32_t multisampledImageBucket = 256;
+
+    /** Takes multisampled image of previous targets when it's big enough and not more than a bucket larger
+     * than needed. Framebuffers and render area use actual extent, so the rest of the image is left unused.
+     */
+    void createMultisampledImage(TargetContext& previous) {
+        if(graphicSettings.sampleCount == vk::SampleCountFlagBits::e1) return;
+        vk::Extent2D extent = targetContext.framebufferExtent;
+        vk::Extent2D bucketExtent {
+                (extent.width + multisampledImageBucket - 1) / multisampledImageBucket * multisampledImageBucket,
+                (extent.height + multisampledImageBucket - 1) / multisampledImageBucket * multisampledImageBucket
+        };
+        vk::Extent2D previousExtent = previous.imageExtent;
+        if(previous.image && previousExtent.width >= extent.width && previousExtent.height >= extent.height &&
+           previousExtent.width <= bucketExtent.width && previousExtent.height <= bucketExtent.height) {
+            targetContext.image = std::move(previous.image);
+            targetContext.imageExtent = previousExtent;
+        } else {
+            // Multisampled contents are resolved within render pass and never stored, so the image can stay in tile memory
+            targetContext.image = createImage(bucketExtent, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransientAttachment,
+                                              graphicSettings.sampleCount);
+            targetContext.imageExtent = bucketExtent;
+        }
+    }
 
-        recordCommandBuffers();
+    void createFramebuffer(vk::ImageView resolveView) {
+        bool multisampled = targetContext.image;
+        vk::ImageView views[] {multisampled ? targetContext.image.view : resolveView, resolveView};
+        targetContext.framebuffers.push_back(device.createFramebufferUnique(vk::FramebufferCreateInfo{
+                /*flags*/           {},
+                /*renderPass*/      *renderPass,
+                /*attachmentCount*/ multisampled ? 2U : 1U,
+                /*pAttachments*/    views,
+                /*width*/           targetContext.framebufferExtent.width,
+                /*height*/          targetContext.framebufferExtent.height,
+                /*layers*/          1
+        }));
+    }
+
+    /** Framebuffer for each swapchain image, or for each offscreen image */
+    void createFramebuffers() {
+        size_t count = offscreen ? targetContext.offscreenImages.size() : swapchain.images.size();
+        targetContext.framebuffers.clear();
+        targetContext.framebuffers.reserve(count);
+        for(size_t i = 0; i < count; i++) {
+            createFramebuffer(offscreen ? targetContext.offscreenImages[i].view : *swapchain.imageViews[i]);
+        }
+    }
+
+    /** Render pass and graphics pipelines are created again for new sample count, targets too.
+     * Previous ones are retired like old swapchain, frames record their command buffers again when reused.
+     */
+    void updateSampleCount(vk::SampleCountFlagBits sampleCount) {
+        if(sampleCount == graphicSettings.sampleCount) return;
+        RetiredTarget retired {submittedSerial};
+        retired.renderPass = std::move(renderPass);
+        retired.pipelines = std::move(pipelines);
+        retired.targetContext.image = std::move(targetContext.image);
+        retired.targetContext.framebuffers = std::move(targetContext.framebuffers);
+        targetContext.image = {};
+        targetContext.imageExtent = {};
+        targetContext.framebuffers.clear();
+
+        graphicSettings.sampleCount = sampleCount;
+        createRenderPass();
+        createGraphicsPipelines();
+        if(targetContext.extent.width != 0 && targetContext.extent.height != 0) {
+            TargetContext none;
+            createMultisampledImage(none);
+            createFramebuffers();
+        }
+        for(Frame& frame : frames) frame.targetOutdated = true;
+        retiredTargets.push_back(std::move(retired));
+        releaseRetiredTargets();
+    }
+
+    /** Frame time is measured with timestamps, which are written also for automatic antialiasing */
+    [[nodiscard]] bool measuring() const {
+        return (profiling || graphicSettings.antialiasing == GraphicSettings::Antialiasing::AUTO) && timestampMask != 0;
+    }
 
+    /** Steps sample count down once average GPU frame time over the window exceeds budget, and back up towards
+     * the automatic mode's maximum once it stays below a fraction of budget, low enough for doubled samples to fit.
+     */
+    void adaptSampleCount(double milliseconds) {
+        antialiasingMilliseconds += milliseconds;
+        if(++antialiasingFrames < antialiasingWindow) return;
+        double average = antialiasingMilliseconds / antialiasingFrames;
+        antialiasingMilliseconds = 0;
+        antialiasingFrames = 0;
+        auto samples = (uint32_t) graphicSettings.sampleCount;
+        if(average > graphicSettings.frameBudgetMilliseconds) {
+            antialiasingRecoveredWindows = 0;
+            if(samples != 1) updateSampleCount(graphicSettings.selectSampleCount(samples / 2));
+        } else if(average < graphicSettings.frameBudgetMilliseconds * antialiasingRecoveryBudgetFraction &&
+                  samples < (uint32_t) graphicSettings.selectSampleCount(GraphicSettings::Antialiasing::AUTO)) {
+            if(++antialiasingRecoveredWindows < antialiasingRecoveryWindows) return;
+            antialiasingRecoveredWindows = 0;
+            vk::SampleCountFlagBits higher = graphicSettings.selectSampleCount(GraphicSettings::Antialiasing::AUTO);
+            // Next supported count above current one, AUTO maximum is always supported
+            for(uint32_t candidate = samples * 2; candidate < (uint32_t) higher; candidate *= 2) {
+                auto bit = (vk::SampleCountFlagBits) candidate;
+                if((graphicSettings.supportedSampleCounts & bit) == bit) {
+                    higher = bit;
+                    break;
+                }
+            }
+            updateSampleCount(higher);
+        } else antialiasingRecoveredWindows = 0;
     }
 
 
 
-    bool ensureBufferSize(vma::StreamBuffer& buffer, vk::DeviceSize size, vk::BufferUsageFlagBits usage) {
-        if(!buffer || buffer.allocationInfo.size < size) {
-            buffer = vma::StreamBuffer(vma, vk::BufferCreateInfo{
+    /** Returns false if geometry buffer of the frame had to be reallocated, losing its contents.
+     * Frame must not be in flight, its command buffers bind the buffer and must be recorded again.
+     */
+    bool ensureGeometryBufferSize(Frame& frame, vk::DeviceSize size) {
+        if(!frame.geometryBuffer || frame.geometryBuffer.allocationInfo.size < size) {
+            frame.geometryBuffer = {};
+            frame.geometryBuffer = vma::DeviceBuffer(vma, vk::BufferCreateInfo{
                     /*flags*/                 {},
-                    /*size*/                  size,
-                    /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | usage,
+                    /*size*/                  std::max<vk::DeviceSize>(size * 2, 64 * 1024),
+                    /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer,
                     /*sharingMode*/           vk::SharingMode::eExclusive,
                     /*queueFamilyIndexCount*/ 0,
                     /*pQueueFamilyIndices*/   nullptr
@@ -575,93 +1296,998 @@ public:
 
 
 
-    void render(const std::vector<std::vector<glm::dvec2>>& polygonSet, const Triangulation* const triangulation, glm::dvec2 scale) {
-        device->waitForFences({*renderingCompleteFence}, true, -1);
-        device->resetFences({*renderingCompleteFence});
+    /** Returns false if chunk and draw buffers had to be reallocated, losing their contents.
+     * Capacities are drawn by a single multi-draw, so they never exceed maxDrawIndirectCount, chunk counts must fit into it.
+     */
+    bool ensureCullBufferCapacity(Frame& frame) {
+        if(frame.chunkBuffer && triangleChunks.size() <= frame.triangleChunkCapacity && polygonOutline.chunks.size() <= frame.polygonChunkCapacity) return true;
+        auto capacity = [&](size_t chunks) {
+            return (uint32_t) std::min<uint64_t>(std::max<uint64_t>(chunks * 2, 64), maxDrawIndirectCount);
+        };
+        if(triangleChunks.size() > frame.triangleChunkCapacity) frame.triangleChunkCapacity = capacity(triangleChunks.size());
+        if(polygonOutline.chunks.size() > frame.polygonChunkCapacity) frame.polygonChunkCapacity = capacity(polygonOutline.chunks.size());
+        vk::DeviceSize chunks = frame.triangleChunkCapacity + frame.polygonChunkCapacity;
+        frame.chunkBuffer = {};
+        frame.drawBuffer = {};
+        frame.chunkBuffer = vma::DeviceBuffer(vma, vk::BufferCreateInfo{
+                /*flags*/                 {},
+                /*size*/                  chunks * sizeof(Chunk),
+                /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+                /*sharingMode*/           vk::SharingMode::eExclusive,
+                /*queueFamilyIndexCount*/ 0,
+                /*pQueueFamilyIndices*/   nullptr
+        });
+        frame.drawBuffer = vma::DeviceBuffer(vma, vk::BufferCreateInfo{
+                /*flags*/                 {},
+                /*size*/                  cullDrawsOffset + chunks * sizeof(vk::DrawIndexedIndirectCommand),
+                /*usage*/                 vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+                /*sharingMode*/           vk::SharingMode::eExclusive,
+                /*queueFamilyIndexCount*/ 0,
+                /*pQueueFamilyIndices*/   nullptr
+        });
+        vk::DescriptorBufferInfo chunkBufferInfo{
+                /*buffer*/ *frame.chunkBuffer,
+                /*offset*/ 0,
+                /*range*/  VK_WHOLE_SIZE
+        };
+        vk::DescriptorBufferInfo drawBufferInfo{
+                /*buffer*/ *frame.drawBuffer,
+                /*offset*/ 0,
+                /*range*/  VK_WHOLE_SIZE
+        };
+        device.updateDescriptorSets({
+            vk::WriteDescriptorSet{
+                /*dstSet*/           frame.cullDescriptorSet,
+                /*dstBinding*/       1,
+                /*dstArrayElement*/  0,
+                /*descriptorCount*/  1,
+                /*descriptorType*/   vk::DescriptorType::eStorageBuffer,
+                /*pImageInfo*/       nullptr,
+                /*pBufferInfo*/      &chunkBufferInfo,
+                /*pTexelBufferView*/ nullptr
+            },
+            vk::WriteDescriptorSet{
+                /*dstSet*/           frame.cullDescriptorSet,
+                /*dstBinding*/       2,
+                /*dstArrayElement*/  0,
+                /*descriptorCount*/  1,
+                /*descriptorType*/   vk::DescriptorType::eStorageBuffer,
+                /*pImageInfo*/       nullptr,
+                /*pBufferInfo*/      &drawBufferInfo,
+                /*pTexelBufferView*/ nullptr
+            }
+        }, {});
+        return false;
+    }
+
+
 
-        {
-            auto extent = (glm::vec2*) uniformBuffer.allocationInfo.pMappedData;
-            extent->x = (float) swapchain.extent.width / scale.x;
-            extent->y = (float) swapchain.extent.height / scale.y;
+    /** Splits triangles into chunks of consecutive triangles. Triangulation emits triangles polygon by polygon,
+     * so consecutive triangles are close to each other and chunk bounds stay tight without any spatial sorting.
+     */
+    void updateTriangleChunks(const Triangulation* triangulation, uint64_t triangulationId) {
+        if(triangleChunksTriangulationId == triangulationId) return;
+        triangleChunksTriangulationId = triangulationId;
+        triangleChunks.clear();
+        if(triangulation == nullptr) return;
+        for(size_t first = 0; first < triangulation->triangles.size(); first += chunkTriangles) {
+            size_t last = std::min(first + chunkTriangles, triangulation->triangles.size());
+            glm::dvec2 min = triangulation->vertices[triangulation->triangles[first].x], max = min;
+            for(size_t i = first; i < last; i++) {
+                for(int j = 0; j < 3; j++) {
+                    const glm::dvec2& vertex = triangulation->vertices[triangulation->triangles[i][j]];
+                    min = glm::min(min, vertex);
+                    max = glm::max(max, vertex);
+                }
+            }
+            triangleChunks.push_back(Chunk{glm::vec2(min), glm::vec2(max), (uint32_t) first * 3, (uint32_t) (last - first) * 3});
         }
-        bool reRecordBuffer = false;
-        if(triangulation != nullptr) {
-            if(!triangulation->vertices.empty()) {
-                if(!ensureBufferSize(vertexBuffer, triangulation->vertices.size() * sizeof(glm::vec2) * 2, vk::BufferUsageFlagBits::eVertexBuffer)) {
-                    reRecordBuffer = true;
+    }
+
+    /** Simplifies closed polygon ring with Douglas-Peucker algorithm, keeping vertices deviating from simplified
+     * outline by more than tolerance. Ring is given as indices into polygon, at least 3 vertices are always kept,
+     * so that no polygon degenerates or disappears, however coarse the level is.
+     */
+    static void simplifyRing(const std::vector<glm::dvec2>& polygon, std::vector<uint32_t>& ring, double tolerance) {
+        if(ring.size() <= 3) return;
+        auto distance = [&](size_t point, size_t first, size_t last) {
+            glm::dvec2 a = polygon[ring[first]], b = polygon[ring[last % ring.size()]], p = polygon[ring[point]];
+            glm::dvec2 ab = b - a, ap = p - a;
+            double length = glm::dot(ab, ab);
+            double t = length == 0 ? 0 : std::clamp(glm::dot(ap, ab) / length, 0.0, 1.0);
+            return glm::length(ap - ab * t);
+        };
+        // Ring is split by its first vertex and the vertex farthest from it, giving two open chains
+        size_t farthest = 1;
+        for(size_t i = 2; i < ring.size(); i++) {
+            if(glm::distance(polygon[ring[i]], polygon[ring[0]]) > glm::distance(polygon[ring[farthest]], polygon[ring[0]])) farthest = i;
+        }
+        std::vector<bool> keep(ring.size(), false);
+        keep[0] = keep[farthest] = true;
+        size_t kept = 2, mostDistant = 0;
+        double mostDistantDistance = -1;
+        std::vector<std::pair<size_t, size_t>> chains {{0, farthest}, {farthest, ring.size()}};
+        while(!chains.empty()) {
+            auto [first, last] = chains.back();
+            chains.pop_back();
+            size_t point = 0;
+            double pointDistance = -1;
+            for(size_t i = first + 1; i < last; i++) {
+                double d = distance(i, first, last);
+                if(d > pointDistance) {
+                    point = i;
+                    pointDistance = d;
                 }
-                auto vertices = (glm::vec2*) vertexBuffer.allocationInfo.pMappedData;
-                for (int i = 0; i < triangulation->vertices.size(); i++) {
-                    vertices[i] = glm::vec2(triangulation->vertices[i]);
+            }
+            if(pointDistance > mostDistantDistance) {
+                mostDistant = point;
+                mostDistantDistance = pointDistance;
+            }
+            if(pointDistance > tolerance) {
+                keep[point] = true;
+                kept++;
+                chains.emplace_back(first, point);
+                chains.emplace_back(point, last);
+            }
+        }
+        if(kept < 3) keep[mostDistant] = true;
+        size_t size = 0;
+        for(size_t i = 0; i < ring.size(); i++) {
+            if(keep[i]) ring[size++] = ring[i];
+        }
+        ring.resize(size);
+    }
+
+    /** Proper crossing of segments ab and cd. Segments sharing an endpoint or touching each other don't cross */
+    static bool segmentsCross(glm::dvec2 a, glm::dvec2 b, glm::dvec2 c, glm::dvec2 d) {
+        auto orientation = [](glm::dvec2 p, glm::dvec2 q, glm::dvec2 r) {
+            double cross = (q.x - p.x) * (r.y - p.y) - (q.y - p.y) * (r.x - p.x);
+            return (cross > 0) - (cross < 0);
+        };
+        return orientation(a, b, c) * orientation(a, b, d) < 0 && orientation(c, d, a) * orientation(c, d, b) < 0;
+    }
+
+    /** Simplifies every ring with given tolerance without introducing new crossings. Each edge which replaced removed vertices
+     * is tested against all current edges near it and against removed edges of other rings and of other parts of its ring,
+     * found through uniform grid over polygon set bounds. Crossing edges get their removed vertices back. Edges kept don't
+     * cross even what was restored, so a single pass is enough. Crossings already present in the input stay, edges close
+     * to them are just left unsimplified. Returns early once cancelled.
+     */
+    static void simplifyRings(const std::vector<std::vector<glm::dvec2>>& polygonSet, std::vector<std::vector<uint32_t>>& rings,
+                              double tolerance, glm::dvec2 min, glm::dvec2 max, const std::atomic<bool>* cancelled) {
+        std::vector<std::vector<uint32_t>> previous = rings;
+        for(size_t i = 0; i < rings.size(); i++) {
+            if(cancelled != nullptr && *cancelled) return;
+            simplifyRing(polygonSet[i], rings[i], tolerance);
+        }
+
+        // Edge starts at given position of simplified ring, or of previous ring when it was removed.
+        // New edge replaced previous edges from its start position there up to its end, which is always kept
+        struct Edge {
+            uint32_t ring, position;
+            bool removed;
+            uint32_t previousFirst, previousCount;
+        };
+        std::vector<Edge> edges;
+        for(uint32_t i = 0; i < rings.size(); i++) {
+            if(rings[i].size() < 2) continue;
+            for(uint32_t j = 0; j < rings[i].size(); j++) {
+                // Rings are ascending, so previous edges of this one start at its first vertex and end before the next one
+                auto first = (uint32_t) (std::lower_bound(previous[i].begin(), previous[i].end(), rings[i][j]) - previous[i].begin());
+                uint32_t end = rings[i][(j + 1) % rings[i].size()], count = 1;
+                while(previous[i][(first + count) % previous[i].size()] != end) count++;
+                edges.push_back(Edge{i, j, false, first, count});
+                if(count == 1) continue;
+                for(uint32_t k = 0; k < count; k++) edges.push_back(Edge{i, first + k, true, 0, 0});
+            }
+        }
+        auto endpoints = [&](const Edge& edge) {
+            const std::vector<uint32_t>& r = edge.removed ? previous[edge.ring] : rings[edge.ring];
+            return std::pair<glm::dvec2, glm::dvec2>(polygonSet[edge.ring][r[edge.position]],
+                                                     polygonSet[edge.ring][r[(edge.position + 1) % r.size()]]);
+        };
+
+        // Edges are bucketed into every cell they pass through, row by row, about 16 edges per cell, cells are stored one after another
+        size_t gridSize = std::clamp<size_t>((size_t) std::sqrt((double) edges.size() / 16), 1, 1024);
+        glm::dvec2 extent = max - min;
+        glm::dvec2 cellScale(extent.x > 0 ? (double) gridSize / extent.x : 0, extent.y > 0 ? (double) gridSize / extent.y : 0);
+        auto cell = [&](double coordinate, double origin, double scale) {
+            return std::min((size_t) std::max((coordinate - origin) * scale, 0.0), gridSize - 1);
+        };
+        auto forEachCell = [&](const Edge& edge, auto&& action) {
+            auto [a, b] = endpoints(edge);
+            if(a.y > b.y) std::swap(a, b);
+            size_t y0 = cell(a.y, min.y, cellScale.y), y1 = cell(b.y, min.y, cellScale.y);
+            for(size_t y = y0; y <= y1; y++) {
+                // Part of the edge within this row
+                double xMin = a.x, xMax = b.x;
+                if(y0 != y1) {
+                    double rowMin = y == y0 ? a.y : min.y + (double) y / cellScale.y, rowMax = y == y1 ? b.y : min.y + (double) (y + 1) / cellScale.y;
+                    xMin = a.x + (rowMin - a.y) / (b.y - a.y) * (b.x - a.x);
+                    xMax = a.x + (rowMax - a.y) / (b.y - a.y) * (b.x - a.x);
                 }
-                vertexBuffer.flush(0, VK_WHOLE_SIZE);
+                size_t x0 = cell(std::min(xMin, xMax), min.x, cellScale.x), x1 = cell(std::max(xMin, xMax), min.x, cellScale.x);
+                for(size_t x = x0; x <= x1; x++) action(y * gridSize + x);
             }
-            if(!triangulation->triangles.empty()) {
-                if(!ensureBufferSize(triangleIndexBuffer, triangulation->triangles.size() * sizeof(glm::ivec3) * 2, vk::BufferUsageFlagBits::eIndexBuffer)) {
-                    reRecordBuffer = true;
+        };
+        std::vector<uint32_t> cellStart(gridSize * gridSize + 1, 0), cellEdges;
+        for(const Edge& edge : edges) forEachCell(edge, [&](size_t c) { cellStart[c + 1]++; });
+        for(size_t c = 0; c < gridSize * gridSize; c++) cellStart[c + 1] += cellStart[c];
+        cellEdges.resize(cellStart.back());
+        std::vector<uint32_t> cellFill(cellStart.begin(), cellStart.end() - 1);
+        for(size_t e = 0; e < edges.size(); e++) forEachCell(edges[e], [&](size_t c) { cellEdges[cellFill[c]++] = (uint32_t) e; });
+        if(cancelled != nullptr && *cancelled) return;
+
+        std::vector<std::vector<bool>> restore(rings.size());
+        for(const Edge& edge : edges) {
+            if(edge.removed || edge.previousCount == 1) continue;
+            if(cancelled != nullptr && *cancelled) return;
+            auto [a, b] = endpoints(edge);
+            bool crosses = false;
+            forEachCell(edge, [&](size_t c) {
+                for(uint32_t k = cellStart[c]; k < cellStart[c + 1] && !crosses; k++) {
+                    const Edge& other = edges[cellEdges[k]];
+                    // Edge replaces the vertices it passes by, so it may cross edges between them
+                    if(other.removed && other.ring == edge.ring && (uint32_t) (other.position - edge.previousFirst) < edge.previousCount) continue;
+                    auto [c0, c1] = endpoints(other);
+                    crosses = segmentsCross(a, b, c0, c1);
                 }
-                std::memcpy(triangleIndexBuffer.allocationInfo.pMappedData, triangulation->triangles.data(), triangulation->triangles.size() * sizeof(glm::ivec3));
-                triangleIndexBuffer.flush(0, VK_WHOLE_SIZE);
+            });
+            if(!crosses) continue;
+            if(restore[edge.ring].empty()) restore[edge.ring].resize(rings[edge.ring].size(), false);
+            restore[edge.ring][edge.position] = true;
+        }
+
+        // Crossing edges get back all vertices of previous ring between their endpoints
+        for(size_t i = 0; i < rings.size(); i++) {
+            if(restore[i].empty()) continue;
+            std::vector<uint32_t> ring;
+            for(size_t j = 0; j < rings[i].size(); j++) {
+                ring.push_back(rings[i][j]);
+                if(!restore[i][j]) continue;
+                uint32_t end = rings[i][(j + 1) % rings[i].size()];
+                auto k = (size_t) (std::lower_bound(previous[i].begin(), previous[i].end(), rings[i][j]) - previous[i].begin());
+                for(k++; k < previous[i].size() && previous[i][k] != end; k++) ring.push_back(previous[i][k]);
+            }
+            rings[i] = std::move(ring);
+        }
+    }
+
+    /** Appends outline indices (first, ..., last, first, restart) of given rings as a new level, and splits them
+     * into chunks of fixed size. Neighbouring chunks share one index, so that no edge is lost when a line strip
+     * is split between them.
+     */
+    static void appendPolygonLevel(PolygonOutline& outline, const std::vector<std::vector<glm::dvec2>>& polygonSet,
+                                   const std::vector<uint32_t>& firstVertices, const std::vector<std::vector<uint32_t>>& rings,
+                                   double tolerance) {
+        std::vector<uint32_t>& indices = outline.indices;
+        std::vector<Chunk>& chunks = outline.chunks;
+        PolygonLevel level {tolerance, (uint32_t) indices.size(), 0, (uint32_t) chunks.size(), 0};
+        size_t chunkFirst = indices.size();
+        glm::dvec2 min {DBL_MAX}, max {-DBL_MAX};
+        auto emit = [&](uint32_t index, const glm::dvec2* vertex) {
+            indices.push_back(index);
+            if(vertex != nullptr) {
+                min = glm::min(min, *vertex);
+                max = glm::max(max, *vertex);
+            }
+            if(indices.size() - chunkFirst == chunkPolygonIndices + 1) {
+                chunks.push_back(Chunk{glm::vec2(min), glm::vec2(max), (uint32_t) chunkFirst, (uint32_t) (indices.size() - chunkFirst)});
+                chunkFirst = indices.size() - 1;
+                min = vertex != nullptr ? *vertex : glm::dvec2(DBL_MAX);
+                max = vertex != nullptr ? *vertex : glm::dvec2(-DBL_MAX);
+            }
+        };
+        for(size_t i = 0; i < rings.size(); i++) {
+            if(rings[i].size() < 2) continue;
+            for(uint32_t vertex : rings[i]) emit(firstVertices[i] + vertex, &polygonSet[i][vertex]);
+            emit(firstVertices[i] + rings[i][0], &polygonSet[i][rings[i][0]]);
+            emit(UINT32_MAX, nullptr);
+        }
+        // Last chunk may consist of a single index shared with the previous one
+        if(indices.size() > chunkFirst + (chunks.size() == level.firstChunk ? 0 : 1)) {
+            chunks.push_back(Chunk{glm::vec2(min), glm::vec2(max), (uint32_t) chunkFirst, (uint32_t) (indices.size() - chunkFirst)});
+        }
+        level.indexCount = (uint32_t) indices.size() - level.firstIndex;
+        level.chunkCount = (uint32_t) chunks.size() - level.firstChunk;
+        outline.levels.push_back(level);
+    }
+
+    /** Builds given number of outline levels of detail with their chunks. Each level simplifies the previous one with 4 times
+     * larger tolerance, starting at 1/65536 of polygon set size, so levels get geometrically smaller and cheaper to build.
+     * Levels only select a subset of vertices, so all of them share polygon vertices already in geometry buffer.
+     * Returns empty outline once cancelled.
+     */
+    static PolygonOutline buildPolygonOutline(const std::vector<std::vector<glm::dvec2>>& polygonSet, uint32_t levelCount,
+                                              const std::atomic<bool>* cancelled) {
+        PolygonOutline outline;
+        std::vector<uint32_t> firstVertices;
+        std::vector<std::vector<uint32_t>> rings;
+        glm::dvec2 min {DBL_MAX}, max {-DBL_MAX};
+        size_t vertices = 0;
+        uint32_t first = 0;
+        for(const std::vector<glm::dvec2>& polygon : polygonSet) {
+            firstVertices.push_back(first);
+            std::vector<uint32_t>& ring = rings.emplace_back(polygon.size());
+            for(uint32_t i = 0; i < polygon.size(); i++) ring[i] = i;
+            if(!polygon.empty()) {
+                glm::dvec2 polygonMin, polygonMax;
+                getVertexKernels().computeBounds(polygon.data(), polygon.size(), polygonMin, polygonMax);
+                min = glm::min(min, polygonMin);
+                max = glm::max(max, polygonMax);
+            }
+            vertices += polygon.size();
+            first += (uint32_t) polygon.size();
+        }
+        appendPolygonLevel(outline, polygonSet, firstVertices, rings, 0);
+        if(vertices == 0) return outline;
+
+        double tolerance = glm::distance(min, max) / 65536;
+        for(uint32_t level = 1; level < levelCount; level++, tolerance *= 4) {
+            simplifyRings(polygonSet, rings, tolerance, min, max, cancelled);
+            if(cancelled != nullptr && *cancelled) return {};
+            size_t simplifiedVertices = 0;
+            for(const std::vector<uint32_t>& ring : rings) simplifiedVertices += ring.size();
+            if(simplifiedVertices == vertices) {
+                // Nothing was removed, so the level is the same as the previous one
+                PolygonLevel same = outline.levels.back();
+                same.tolerance = tolerance;
+                outline.levels.push_back(same);
+            }
+            else appendPolygonLevel(outline, polygonSet, firstVertices, rings, tolerance);
+            vertices = simplifiedVertices;
+        }
+        return outline;
+    }
+
+    /** Stops building outline levels of the previous polygon set without waiting for it */
+    void cancelPolygonLevels() {
+        if(polygonLevelsCancelled) *polygonLevelsCancelled = true;
+        polygonLevelsCancelled.reset();
+        if(polygonLevelsBuild.valid()) cancelledPolygonLevelsBuilds.push_back(std::move(polygonLevelsBuild));
+    }
+
+    /** Builds outline of polygon set once its version changes. Large sets get only the exact level right away, coarser levels
+     * are built by a background task from a copy of the set and picked up by a later frame, so that editing doesn't stall
+     * rendering. Offscreen renderer draws every polygon set just once, so it builds all levels immediately.
+     */
+    void updatePolygonChunks(const std::vector<std::vector<glm::dvec2>>& polygonSet, uint64_t polygonSetVersion) {
+        std::erase_if(cancelledPolygonLevelsBuilds, [](const std::future<PolygonOutline>& build) {
+            return build.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+        if(polygonChunksVersion != polygonSetVersion) {
+            polygonChunksVersion = polygonSetVersion;
+            cancelPolygonLevels();
+            size_t vertices = 0;
+            for(const std::vector<glm::dvec2>& polygon : polygonSet) vertices += polygon.size();
+            bool async = !offscreen && vertices >= asyncPolygonLevelsVertices;
+            polygonOutline = buildPolygonOutline(polygonSet, async ? 1 : maxPolygonLevels, nullptr);
+            polygonOutlineRevision++;
+            if(async) {
+                auto cancelled = std::make_shared<std::atomic<bool>>(false);
+                polygonLevelsCancelled = cancelled;
+                polygonLevelsBuild = std::async(std::launch::async, [polygonSet, cancelled]() {
+                    return buildPolygonOutline(polygonSet, maxPolygonLevels, cancelled.get());
+                });
             }
         }
-        *((vk::DrawIndexedIndirectCommand*) triangleDrawIndirectBuffer.allocationInfo.pMappedData) = vk::DrawIndexedIndirectCommand {
-                /*indexCount*/    triangulation == nullptr ? 0 : (uint32_t) triangulation->triangles.size() * 3,
+        else if(polygonLevelsBuild.valid() && polygonLevelsBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            polygonLevelsCancelled.reset();
+            polygonOutline = polygonLevelsBuild.get();
+            polygonOutlineRevision++;
+        }
+    }
+
+    /** Picks the coarsest outline level, which deviates from exact outline by at most half a pixel */
+    static const PolygonLevel& selectPolygonLevel(const PolygonOutline& outline, glm::dvec2 scale) {
+        double halfPixel = 0.5 / std::max(scale.x, scale.y);
+        size_t level = 0;
+        while(level + 1 < outline.levels.size() && outline.levels[level + 1].tolerance <= halfPixel) level++;
+        return outline.levels[level];
+    }
+
+
+
+    /** Remembers CPU timings of submitted frame, GPU results are added once it is rendered */
+    void finishFrameStatistics(Frame& frame, std::chrono::steady_clock::time_point presentStart) {
+        if(!measuring() || !frame.timestampQueryPool) return;
+        auto presentEnd = std::chrono::steady_clock::now();
+        frame.pendingStatistics = {};
+        frame.pendingStatistics.uploadMilliseconds = std::chrono::duration<double, std::milli>(presentStart - frame.uploadStart).count();
+        frame.pendingStatistics.presentMilliseconds = std::chrono::duration<double, std::milli>(presentEnd - presentStart).count();
+        frame.queriesPending = true;
+    }
+
+    /** Reads queries of a frame whose fence is already signaled, so results are available without waiting */
+    void collectStatistics(Frame& frame) {
+        frame.queriesPending = false;
+        FrameStatistics& result = frame.pendingStatistics;
+        uint64_t timestamps[FrameStatistics::PASS_COUNT + 1];
+        vk::Result timestampResult = device.getQueryPoolResults(*frame.timestampQueryPool, 0, FrameStatistics::PASS_COUNT + 1,
+                sizeof(timestamps), timestamps, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+        if(timestampResult != vk::Result::eSuccess) return;
+        for(size_t i = 0; i < FrameStatistics::PASS_COUNT; i++) {
+            result.passes[i].gpuMilliseconds = (double) ((timestamps[i + 1] - timestamps[i]) & timestampMask) * timestampPeriod / 1e6;
+        }
+        if(graphicSettings.antialiasing == GraphicSettings::Antialiasing::AUTO) {
+            adaptSampleCount((double) ((timestamps[FrameStatistics::PASS_COUNT] - timestamps[0]) & timestampMask) * timestampPeriod / 1e6);
+        }
+        if(!profiling) return;
+        if(frame.statisticsQueryPool) {
+            // Values of each query are ordered by bits of pipelineStatisticFlags
+            uint64_t values[FrameStatistics::PASS_COUNT][4];
+            vk::Result statisticsResult = device.getQueryPoolResults(*frame.statisticsQueryPool, 0, FrameStatistics::PASS_COUNT,
+                    sizeof(values), values, sizeof(values[0]), vk::QueryResultFlagBits::e64);
+            if(statisticsResult == vk::Result::eSuccess) {
+                for(size_t i = 0; i < FrameStatistics::PASS_COUNT; i++) {
+                    result.passes[i].primitives = (double) values[i][0];
+                    result.passes[i].vertexInvocations = (double) values[i][1];
+                    result.passes[i].fragmentInvocations = (double) values[i][2];
+                    result.passes[i].computeInvocations = (double) values[i][3];
+                }
+            }
+        }
+        statistics.add(result);
+    }
+
+
+
+    /** Allocates region of staging ring to hold given amount of data for this frame */
+    void beginStaging(Frame& frame, vk::DeviceSize size) {
+        frame.stagedCopies.clear();
+        frame.stagingRingPosition = stagingRing.position();
+        if(size == 0) return;
+        std::optional<vk::DeviceSize> offset = stagingRing.allocate(size, 16);
+        if(!offset) {
+            // Ring is full of data used by frames in flight. Instead of waiting for them, the ring is replaced by a larger one
+            // and the old one is retired until they are complete
+            vk::DeviceSize capacity = std::max(stagingRing.capacity() * 2, size * 2);
+            RetiredTarget retired {submittedSerial};
+            retired.stagingRing = std::move(stagingRing);
+            retiredTargets.push_back(std::move(retired));
+            stagingRing = vma::RingBuffer(vma, capacity, vk::BufferUsageFlagBits::eTransferSrc);
+            // New ring starts at position 0, so positions remembered from the old one must not be retired into it
+            for(Frame& other : frames) other.stagingRingPosition = 0;
+            offset = stagingRing.allocate(size, 16);
+        }
+        frame.stagingBegin = frame.stagingOffset = *offset;
+        frame.stagingRingPosition = stagingRing.position();
+    }
+
+    /** Returns staging memory, which will be copied into destination buffer before drawing */
+    void* stage(Frame& frame, vk::Buffer destination, vk::DeviceSize destinationOffset, vk::DeviceSize size) {
+        void* data = stagingRing.data(frame.stagingOffset);
+        frame.stagedCopies.emplace_back(destination, vk::BufferCopy{
+                /*srcOffset*/ frame.stagingOffset,
+                /*dstOffset*/ destinationOffset,
+                /*size*/      size
+        });
+        frame.stagingOffset += (size + 15) / 16 * 16;
+        return data;
+    }
+
+    /** Records copies of all staged data, returns false if there is nothing to upload */
+    bool recordUploadCommandBuffer(Frame& frame) {
+        if(frame.stagedCopies.empty()) return false;
+        stagingRing.flush(frame.stagingBegin, frame.stagingOffset - frame.stagingBegin);
+        device.resetCommandPool(*frame.uploadCommandPool, {});
+        frame.uploadCommandBuffer.begin(vk::CommandBufferBeginInfo{
+                /*flags*/            vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+                /*pInheritanceInfo*/ nullptr
+        });
+        // Copies only write buffers of this frame, whose previous submission is complete, so they don't wait for other frames
+        for(const auto& [destination, region] : frame.stagedCopies) {
+            frame.uploadCommandBuffer.copyBuffer(*stagingRing, destination, region);
+        }
+        frame.uploadCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eComputeShader, {},
+                vk::MemoryBarrier{
+                        /*srcAccessMask*/ vk::AccessFlagBits::eTransferWrite,
+                        /*dstAccessMask*/ vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eShaderRead
+                }, nullptr, nullptr);
+        frame.uploadCommandBuffer.end();
+        frame.stagedCopies.clear();
+        return true;
+    }
+
+
+
+    /** Waits until GPU is done with the next frame in flight and releases everything its previous submission used.
+     * Frame's fence is left signaled, it's reset only right before submit, so that failure before that leaves nothing to wait for.
+     */
+    Frame& acquireFrame() {
+        Frame& frame = frames[frameIndex];
+        frameIndex = (frameIndex + 1) % (uint32_t) frames.size();
+        device.waitForFences({*frame.renderingCompleteFence}, true, -1);
+        completedSerial = std::max(completedSerial, frame.serial);
+        releaseRetiredTargets();
+        if(frame.queriesPending) collectStatistics(frame);
+        frame.uploadStart = std::chrono::steady_clock::now();
+        stagingRing.retire(frame.stagingRingPosition);
+        return frame;
+    }
+
+    /** Uploads changed geometry and view of the next frame in flight, waiting until GPU is done with it */
+    Frame& prepareFrame(const std::vector<std::vector<glm::dvec2>>& polygonSet, uint64_t polygonSetVersion,
+                        const Triangulation* const triangulation, glm::dvec2 scale, glm::dvec2 offset) {
+        Frame& frame = acquireFrame();
+
+        bool reRecordBuffer = false;
+        if(frame.targetOutdated) {
+            allocateCommandBuffers(frame);
+            reRecordBuffer = true;
+        }
+        uint64_t triangulationId = triangulation == nullptr ? 0 : triangulation->id;
+        bool uploadTriangulation = frame.uploadedTriangulationId != triangulationId;
+        bool uploadPolygonSet = frame.uploadedPolygonSetVersion != polygonSetVersion;
+        size_t polygonPoints = 0;
+        for(const std::vector<glm::dvec2>& polygon : polygonSet) polygonPoints += polygon.size();
+
+        updateTriangleChunks(triangulation, triangulationId);
+        updatePolygonChunks(polygonSet, polygonSetVersion);
+        // Outline changes with polygon set, and once more when its coarser levels are finished
+        bool uploadPolygonIndices = frame.uploadedPolygonOutlineRevision != polygonOutlineRevision;
+        // Chunks are kept in chunk buffer while frame is not culled, they stay valid if nothing changes until it's culled again
+        bool culling = gpuCulling && triangleChunks.size() <= maxDrawIndirectCount && polygonOutline.chunks.size() <= maxDrawIndirectCount;
+        if(culling != frame.culling) {
+            frame.culling = culling;
+            reRecordBuffer = true;
+        }
+        bool uploadTriangleChunks = culling && frame.chunkTriangulationId != triangulationId;
+        bool uploadPolygonChunks = culling && frame.chunkPolygonOutlineRevision != polygonOutlineRevision;
+
+        vk::DeviceSize triangleVerticesSize = triangulation == nullptr ? 0 : triangulation->vertices.size() * sizeof(glm::vec2);
+        vk::DeviceSize triangleIndicesSize = triangulation == nullptr ? 0 : triangulation->triangles.size() * sizeof(glm::ivec3);
+        if(uploadTriangulation) {
+            // Polygon data is placed right after triangulation, so it moves together with it
+            frame.triangleIndicesOffset = triangleVerticesSize;
+            uploadPolygonSet = true;
+        }
+        if(uploadPolygonSet) {
+            uploadPolygonIndices = true;
+            frame.reusesTriangulationVertices = triangulation != nullptr && triangulation->hasInputVertices(polygonSet);
+            vk::DeviceSize triangulationEnd = (frame.triangleIndicesOffset + triangleIndicesSize + 7) / 8 * 8;
+            frame.polygonVerticesOffset = frame.reusesTriangulationVertices ? 0 : triangulationEnd;
+            frame.polygonIndicesOffset = frame.reusesTriangulationVertices ? triangulationEnd : triangulationEnd + polygonPoints * sizeof(glm::vec2);
+        }
+        vk::DeviceSize polygonVerticesSize = frame.reusesTriangulationVertices ? 0 : polygonPoints * sizeof(glm::vec2);
+        vk::DeviceSize polygonIndicesSize = polygonOutline.indices.size() * sizeof(uint32_t);
+        if(!drawIndirectFirstInstance && frame.recordedPolygonVerticesOffset != frame.polygonVerticesOffset) reRecordBuffer = true;
+        if(!ensureGeometryBufferSize(frame, frame.polygonIndicesOffset + polygonIndicesSize)) {
+            reRecordBuffer = true;
+            uploadTriangulation = true;
+            uploadPolygonSet = true;
+            uploadPolygonIndices = true;
+        }
+        if(culling && !ensureCullBufferCapacity(frame)) {
+            reRecordBuffer = true;
+            uploadTriangleChunks = true;
+            uploadPolygonChunks = true;
+        }
+
+        vk::DeviceSize triangleChunksSize = culling ? triangleChunks.size() * sizeof(Chunk) : 0;
+        vk::DeviceSize polygonChunksSize = culling ? polygonOutline.chunks.size() * sizeof(Chunk) : 0;
+        vk::DeviceSize stagingSize = 0;
+        if(uploadTriangulation) stagingSize += triangleVerticesSize + triangleIndicesSize + 32;
+        if(uploadPolygonSet) stagingSize += polygonVerticesSize + 16;
+        if(uploadPolygonIndices) stagingSize += polygonIndicesSize + 16;
+        if(uploadTriangleChunks) stagingSize += triangleChunksSize + 16;
+        if(uploadPolygonChunks) stagingSize += polygonChunksSize + 16;
+        beginStaging(frame, stagingSize);
+
+        if(uploadTriangulation) {
+            if(triangleVerticesSize != 0) {
+                auto vertices = (glm::vec2*) stage(frame, *frame.geometryBuffer, 0, triangleVerticesSize);
+                getVertexKernels().narrow(triangulation->vertices.data(), vertices, triangulation->vertices.size());
+            }
+            if(triangleIndicesSize != 0) {
+                std::memcpy(stage(frame, *frame.geometryBuffer, frame.triangleIndicesOffset, triangleIndicesSize),
+                        triangulation->triangles.data(), triangleIndicesSize);
+            }
+            frame.uploadedTriangulationId = triangulationId;
+        }
+        if(uploadTriangleChunks) {
+            if(triangleChunksSize != 0) {
+                std::memcpy(stage(frame, *frame.chunkBuffer, 0, triangleChunksSize), triangleChunks.data(), triangleChunksSize);
+            }
+            frame.triangleChunkCount = (uint32_t) triangleChunks.size();
+            frame.chunkTriangulationId = triangulationId;
+        }
+
+        if(uploadPolygonSet) {
+            if(polygonVerticesSize != 0) {
+                auto vertices = (glm::vec2*) stage(frame, *frame.geometryBuffer, frame.polygonVerticesOffset, polygonVerticesSize);
+                for(const std::vector<glm::dvec2>& polygon : polygonSet) {
+                    getVertexKernels().narrow(polygon.data(), vertices, polygon.size());
+                    vertices += polygon.size();
+                }
+            }
+            frame.uploadedPolygonSetVersion = polygonSetVersion;
+        }
+        if(uploadPolygonIndices) {
+            if(polygonIndicesSize != 0) {
+                std::memcpy(stage(frame, *frame.geometryBuffer, frame.polygonIndicesOffset, polygonIndicesSize),
+                        polygonOutline.indices.data(), polygonIndicesSize);
+            }
+            frame.uploadedPolygonOutlineRevision = polygonOutlineRevision;
+        }
+        if(uploadPolygonChunks) {
+            if(polygonChunksSize != 0) {
+                std::memcpy(stage(frame, *frame.chunkBuffer, frame.triangleChunkCapacity * sizeof(Chunk), polygonChunksSize),
+                        polygonOutline.chunks.data(), polygonChunksSize);
+            }
+            frame.chunkPolygonOutlineRevision = polygonOutlineRevision;
+        }
+
+        // Draws are written every frame, as outline level of detail depends on scale
+        const PolygonLevel& polygonLevel = selectPolygonLevel(polygonOutline, scale);
+        *((vk::DrawIndexedIndirectCommand*) frame.triangleDrawIndirectBuffer.allocationInfo.pMappedData) = vk::DrawIndexedIndirectCommand {
+                /*indexCount*/    (uint32_t) (triangleIndicesSize / sizeof(uint32_t)),
                 /*instanceCount*/ 1,
-                /*firstIndex*/    0,
+                /*firstIndex*/    (uint32_t) (frame.triangleIndicesOffset / sizeof(uint32_t)),
                 /*vertexOffset*/  0,
                 /*firstInstance*/ 0
         };
-        triangleDrawIndirectBuffer.flush(0, VK_WHOLE_SIZE);
-
-        int polygonPoints = 0;
-        if(!polygonSet.empty()) {
-            for(const std::vector<glm::dvec2>& polygon : polygonSet) polygonPoints += polygon.size();
-            if(!ensureBufferSize(polygonVerticesBuffer, polygonPoints * sizeof(glm::vec2) * 4, vk::BufferUsageFlagBits::eVertexBuffer)) {
-                reRecordBuffer = true;
-            }
-            auto vertices = (glm::vec2*) polygonVerticesBuffer.allocationInfo.pMappedData;
-            int counter = 0;
-            for(const std::vector<glm::dvec2>& polygon : polygonSet) {
-                for (int i = 0; i < polygon.size(); i++) {
-                    glm::dvec2 vertex = polygon[i];
-                    glm::dvec2 nextVertex = polygon[(i + 1) % polygon.size()];
-                    vertices[counter] = glm::vec2(vertex);
-                    vertices[counter + 1] = glm::vec2(nextVertex);
-                    counter += 2;
+        frame.triangleDrawIndirectBuffer.flush(0, VK_WHOLE_SIZE);
+        *((vk::DrawIndexedIndirectCommand*) frame.polygonDrawIndirectBuffer.allocationInfo.pMappedData) = vk::DrawIndexedIndirectCommand{
+                /*indexCount*/    polygonLevel.indexCount,
+                /*instanceCount*/ 1,
+                /*firstIndex*/    (uint32_t) (frame.polygonIndicesOffset / sizeof(uint32_t)) + polygonLevel.firstIndex,
+                /*vertexOffset*/  (int32_t) (frame.polygonVerticesOffset / sizeof(glm::vec2)),
+                /*firstInstance*/ 0
+        };
+        frame.polygonDrawIndirectBuffer.flush(0, VK_WHOLE_SIZE);
+        *((vk::DrawIndirectCommand*) frame.vertexMarkerDrawIndirectBuffer.allocationInfo.pMappedData) = vk::DrawIndirectCommand{
+                /*vertexCount*/   4,
+                /*instanceCount*/ (uint32_t) polygonPoints,
+                /*firstVertex*/   0,
+                /*firstInstance*/ drawIndirectFirstInstance ? (uint32_t) (frame.polygonVerticesOffset / sizeof(glm::vec2)) : 0
+        };
+        frame.vertexMarkerDrawIndirectBuffer.flush(0, VK_WHOLE_SIZE);
+
+        // Offsets and view are written every frame, they are read by culling shader as well as by vertex shaders
+        *((Uniform*) frame.uniformBuffer.allocationInfo.pMappedData) = Uniform{
+                /*extent*/               glm::vec2(targetContext.extent.width, targetContext.extent.height) / glm::vec2(scale),
+                /*offset*/               glm::vec2(offset),
+                /*triangleFirstIndex*/   (uint32_t) (frame.triangleIndicesOffset / sizeof(uint32_t)),
+                /*polygonFirstIndex*/    (uint32_t) (frame.polygonIndicesOffset / sizeof(uint32_t)),
+                /*polygonVertexOffset*/  (int32_t) (frame.polygonVerticesOffset / sizeof(glm::vec2)),
+                /*triangleChunkCount*/   frame.triangleChunkCount,
+                /*polygonChunkFirst*/    polygonLevel.firstChunk,
+                /*polygonChunkCount*/    polygonLevel.chunkCount
+        };
+        frame.uniformBuffer.flush(0, VK_WHOLE_SIZE);
+
+        if(reRecordBuffer) recordCommandBuffers(frame);
+        return frame;
+    }
+
+    /** Uploads a batch of polygon sets into the next offscreen frame, every set is drawn with the same view into its own image.
+     * Sets are new every time, so everything is uploaded, except triangulations shared by several sets of the batch,
+     * and only outline level selected for the scale. Batches aren't culled, culling uniform describes a single image.
+     */
+    Frame& prepareOffscreenBatch(const std::vector<std::vector<glm::dvec2>>* polygonSets, const Triangulation* const* triangulations,
+                                 uint32_t count, glm::dvec2 scale, glm::dvec2 offset) {
+        Frame& frame = acquireFrame();
+        if(frame.targetOutdated) allocateCommandBuffers(frame);
+
+        // Outline sizes are known only once they are built, so all of them are built before geometry is placed
+        std::vector<PolygonOutline> outlines(count);
+        parallelFor(count, 0, [&](size_t i) {
+            outlines[i] = buildPolygonOutline(polygonSets[i], maxPolygonLevels, nullptr);
+        });
+
+        struct Region {
+            vk::DeviceSize triangleVerticesOffset, triangleIndicesOffset, polygonVerticesOffset, polygonIndicesOffset;
+            uint32_t triangleIndexCount, polygonPoints;
+            bool reusesTriangulationVertices;
+            const PolygonLevel* polygonLevel;
+        };
+        std::vector<Region> regions(count);
+        // Image uploading each triangulation, later images of the batch draw it from the same region
+        std::unordered_map<uint64_t, uint32_t> triangulationImages;
+        vk::DeviceSize size = 0, stagingSize = 0;
+        auto allocate = [&](vk::DeviceSize bytes) {
+            vk::DeviceSize regionOffset = (size + 7) / 8 * 8;
+            size = regionOffset + bytes;
+            stagingSize += bytes + 16;
+            return regionOffset;
+        };
+        for(uint32_t i = 0; i < count; i++) {
+            const Triangulation* triangulation = triangulations[i];
+            Region& region = regions[i];
+            if(triangulation != nullptr) {
+                auto [uploader, inserted] = triangulationImages.try_emplace(triangulation->id, i);
+                if(inserted) {
+                    region.triangleVerticesOffset = allocate(triangulation->vertices.size() * sizeof(glm::vec2));
+                    region.triangleIndicesOffset = allocate(triangulation->triangles.size() * sizeof(glm::ivec3));
+                } else {
+                    region.triangleVerticesOffset = regions[uploader->second].triangleVerticesOffset;
+                    region.triangleIndicesOffset = regions[uploader->second].triangleIndicesOffset;
                 }
+                region.triangleIndexCount = (uint32_t) triangulation->triangles.size() * 3;
+                region.reusesTriangulationVertices = triangulation->hasInputVertices(polygonSets[i]);
             }
-            polygonVerticesBuffer.flush(0, VK_WHOLE_SIZE);
+            for(const std::vector<glm::dvec2>& polygon : polygonSets[i]) region.polygonPoints += (uint32_t) polygon.size();
+            region.polygonVerticesOffset = region.reusesTriangulationVertices ? region.triangleVerticesOffset :
+                                           allocate(region.polygonPoints * sizeof(glm::vec2));
+            region.polygonLevel = &selectPolygonLevel(outlines[i], scale);
+            region.polygonIndicesOffset = allocate(region.polygonLevel->indexCount * sizeof(uint32_t));
         }
-        *((vk::DrawIndirectCommand*) polygonDrawIndirectBuffer.allocationInfo.pMappedData) = vk::DrawIndirectCommand{
-                /*vertexCount*/   (uint32_t) polygonPoints * 2,
-                /*instanceCount*/ 1,
-                /*firstVertex*/   0,
-                /*firstInstance*/ 0
+        ensureGeometryBufferSize(frame, size);
+        beginStaging(frame, stagingSize);
+
+        frame.batchPolygonVerticesOffsets.resize(count);
+        auto triangleDraws = (vk::DrawIndexedIndirectCommand*) frame.triangleDrawIndirectBuffer.allocationInfo.pMappedData;
+        auto polygonDraws = (vk::DrawIndexedIndirectCommand*) frame.polygonDrawIndirectBuffer.allocationInfo.pMappedData;
+        auto vertexMarkerDraws = (vk::DrawIndirectCommand*) frame.vertexMarkerDrawIndirectBuffer.allocationInfo.pMappedData;
+        for(uint32_t i = 0; i < count; i++) {
+            const Triangulation* triangulation = triangulations[i];
+            const Region& region = regions[i];
+            if(triangulation != nullptr && triangulationImages[triangulation->id] == i) {
+                if(!triangulation->vertices.empty()) {
+                    auto vertices = (glm::vec2*) stage(frame, *frame.geometryBuffer, region.triangleVerticesOffset,
+                                                       triangulation->vertices.size() * sizeof(glm::vec2));
+                    getVertexKernels().narrow(triangulation->vertices.data(), vertices, triangulation->vertices.size());
+                }
+                if(!triangulation->triangles.empty()) {
+                    std::memcpy(stage(frame, *frame.geometryBuffer, region.triangleIndicesOffset, triangulation->triangles.size() * sizeof(glm::ivec3)),
+                                triangulation->triangles.data(), triangulation->triangles.size() * sizeof(glm::ivec3));
+                }
+            }
+            if(!region.reusesTriangulationVertices && region.polygonPoints != 0) {
+                auto vertices = (glm::vec2*) stage(frame, *frame.geometryBuffer, region.polygonVerticesOffset, region.polygonPoints * sizeof(glm::vec2));
+                for(const std::vector<glm::dvec2>& polygon : polygonSets[i]) {
+                    getVertexKernels().narrow(polygon.data(), vertices, polygon.size());
+                    vertices += polygon.size();
+                }
+            }
+            if(region.polygonLevel->indexCount != 0) {
+                std::memcpy(stage(frame, *frame.geometryBuffer, region.polygonIndicesOffset, region.polygonLevel->indexCount * sizeof(uint32_t)),
+                            outlines[i].indices.data() + region.polygonLevel->firstIndex, region.polygonLevel->indexCount * sizeof(uint32_t));
+            }
+
+            triangleDraws[i] = vk::DrawIndexedIndirectCommand{
+                    /*indexCount*/    region.triangleIndexCount,
+                    /*instanceCount*/ 1,
+                    /*firstIndex*/    (uint32_t) (region.triangleIndicesOffset / sizeof(uint32_t)),
+                    /*vertexOffset*/  (int32_t) (region.triangleVerticesOffset / sizeof(glm::vec2)),
+                    /*firstInstance*/ 0
+            };
+            polygonDraws[i] = vk::DrawIndexedIndirectCommand{
+                    /*indexCount*/    region.polygonLevel->indexCount,
+                    /*instanceCount*/ 1,
+                    /*firstIndex*/    (uint32_t) (region.polygonIndicesOffset / sizeof(uint32_t)),
+                    /*vertexOffset*/  (int32_t) (region.polygonVerticesOffset / sizeof(glm::vec2)),
+                    /*firstInstance*/ 0
+            };
+            vertexMarkerDraws[i] = vk::DrawIndirectCommand{
+                    /*vertexCount*/   4,
+                    /*instanceCount*/ region.polygonPoints,
+                    /*firstVertex*/   0,
+                    /*firstInstance*/ drawIndirectFirstInstance ? (uint32_t) (region.polygonVerticesOffset / sizeof(glm::vec2)) : 0
+            };
+            frame.batchPolygonVerticesOffsets[i] = region.polygonVerticesOffset;
+        }
+        frame.triangleDrawIndirectBuffer.flush(0, VK_WHOLE_SIZE);
+        frame.polygonDrawIndirectBuffer.flush(0, VK_WHOLE_SIZE);
+        frame.vertexMarkerDrawIndirectBuffer.flush(0, VK_WHOLE_SIZE);
+
+        *((Uniform*) frame.uniformBuffer.allocationInfo.pMappedData) = Uniform{
+                /*extent*/               glm::vec2(targetContext.extent.width, targetContext.extent.height) / glm::vec2(scale),
+                /*offset*/               glm::vec2(offset),
+                /*triangleFirstIndex*/   0,
+                /*polygonFirstIndex*/    0,
+                /*polygonVertexOffset*/  0,
+                /*triangleChunkCount*/   0,
+                /*polygonChunkFirst*/    0,
+                /*polygonChunkCount*/    0
         };
-        polygonDrawIndirectBuffer.flush(0, VK_WHOLE_SIZE);
+        frame.uniformBuffer.flush(0, VK_WHOLE_SIZE);
+
+        // Single image geometry of the frame is overwritten, and draws depend on batch, so command buffers are always recorded
+        frame.batchImageCount = count;
+        frame.culling = false;
+        frame.uploadedTriangulationId.reset();
+        frame.uploadedPolygonSetVersion.reset();
+        frame.uploadedPolygonOutlineRevision.reset();
+        recordCommandBuffers(frame);
+        return frame;
+    }
+
+    /** Called when preparing a frame failed before it was submitted. Its command buffers may be left unrecorded
+     * and staged copies were never executed, so the frame records everything again next time and geometry is uploaded again.
+     */
+    void abandonFrame(Frame& frame) {
+        frame.targetOutdated = true;
+        frame.chunkTriangulationId.reset();
+        frame.chunkPolygonOutlineRevision.reset();
+        frame.uploadedTriangulationId.reset();
+        frame.uploadedPolygonSetVersion.reset();
+        frame.uploadedPolygonOutlineRevision.reset();
+    }
 
-        if(reRecordBuffer) recordCommandBuffers();
 
-        uint32_t image = !device->acquireNextImageKHR(*swapchain, -1, *acquireImageSemaphore, {});
-        vk::CommandBuffer commandBuffer = swapchainContext.commandBuffers[image];
+
+    /** Renders into the next swapchain image. Out of date swapchain is recreated instead of failing,
+     * frame is skipped when there is nothing to render into, for example when window is minimized.
+     */
+    void render(const std::vector<std::vector<glm::dvec2>>& polygonSet, uint64_t polygonSetVersion,
+                const Triangulation* const triangulation, glm::dvec2 scale, glm::dvec2 offset) {
+        // Acquire semaphore of the next frame can be reused only once its previous submission is complete
+        Frame& frame = frames[frameIndex];
+        device.waitForFences({*frame.renderingCompleteFence}, true, -1);
+
+        std::optional<uint32_t> image;
+        for(int attempt = 0; attempt < 2 && !image; attempt++) {
+            if(swapchainOutOfDate) updateSwapchainContext();
+            if(swapchainOutOfDate) return;
+            try {
+                vk::ResultValue<uint32_t> acquired = device.acquireNextImageKHR(*swapchain, -1, *frame.acquireImageSemaphore, {});
+                image = acquired.value;
+                // Suboptimal image is still presentable, swapchain is recreated for the next frame
+                if(acquired.result == vk::Result::eSuboptimalKHR) swapchainOutOfDate = true;
+            } catch(const vk::OutOfDateKHRError&) {
+                swapchainOutOfDate = true;
+            }
+        }
+        if(!image) return;
+
+        bool upload;
+        try {
+            prepareFrame(polygonSet, polygonSetVersion, triangulation, scale, offset);
+            upload = recordUploadCommandBuffer(frame);
+        } catch(...) {
+            // Acquire semaphore stays signaled with nothing waiting for it, and acquired image is never presented,
+            // so the semaphore is created again and swapchain is recreated for the next frame
+            abandonFrame(frame);
+            frame.acquireImageSemaphore = device.createSemaphoreUnique({});
+            swapchainOutOfDate = true;
+            throw;
+        }
+        auto presentStart = std::chrono::steady_clock::now();
+        vk::CommandBuffer commandBuffers[] {frame.uploadCommandBuffer, frame.commandBuffers[*image]};
         vk::PipelineStageFlags waitDstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        std::unique_lock<std::mutex> queueLock(deviceContext->queueMutex);
+        device.resetFences({*frame.renderingCompleteFence});
         queue.submit(vk::SubmitInfo{
                 /*waitSemaphoreCount*/   1,
-                /*pWaitSemaphores*/      &*acquireImageSemaphore,
+                /*pWaitSemaphores*/      &*frame.acquireImageSemaphore,
                 /*pWaitDstStageMask*/    &waitDstStageMask,
-                /*commandBufferCount*/   1,
-                /*pCommandBuffers*/      &commandBuffer,
+                /*commandBufferCount*/   upload ? 2U : 1U,
+                /*pCommandBuffers*/      upload ? commandBuffers : commandBuffers + 1,
                 /*signalSemaphoreCount*/ 1,
-                /*pSignalSemaphores*/    &*renderingCompleteSemaphore
-        }, *renderingCompleteFence);
-        queue.presentKHR(vk::PresentInfoKHR{
-                /*waitSemaphoreCount*/ 1,
-                /*pWaitSemaphores*/    &*renderingCompleteSemaphore,
-                /*swapchainCount*/     1,
-                /*pSwapchains*/        &*swapchain,
-                /*pImageIndices*/      &image,
-                /*pResults*/           nullptr
-        });
+                /*pSignalSemaphores*/    &*frame.renderingCompleteSemaphore
+        }, *frame.renderingCompleteFence);
+        frame.serial = ++submittedSerial;
+        try {
+            vk::Result result = queue.presentKHR(vk::PresentInfoKHR{
+                    /*waitSemaphoreCount*/ 1,
+                    /*pWaitSemaphores*/    &*frame.renderingCompleteSemaphore,
+                    /*swapchainCount*/     1,
+                    /*pSwapchains*/        &*swapchain,
+                    /*pImageIndices*/      &*image,
+                    /*pResults*/           nullptr
+            });
+            if(result == vk::Result::eSuboptimalKHR) swapchainOutOfDate = true;
+        } catch(const vk::OutOfDateKHRError&) {
+            swapchainOutOfDate = true;
+        }
+        queueLock.unlock();
+        finishFrameStatistics(frame, presentStart);
+    }
+
+    /** Index of frame in flight, which will be used by the next render call */
+    [[nodiscard]] uint32_t nextFrameIndex() const {
+        return frameIndex;
+    }
+
+    /** Number of polygon sets rendered by one offscreen frame */
+    [[nodiscard]] uint32_t offscreenBatchSize() const {
+        return offscreenBatch;
+    }
+
+    /** Renders a batch of at most offscreenBatchSize() polygon sets into offscreen images of the next frame in flight
+     * with a single submission, and returns index of that frame. Triangulations may be null.
+     * Rendering is asynchronous, pixels are read by readback() before the frame is reused.
+     */
+    uint32_t renderOffscreen(const std::vector<std::vector<glm::dvec2>>* polygonSets, const Triangulation* const* triangulations,
+                             uint32_t count, glm::dvec2 scale, glm::dvec2 offset) {
+        uint32_t index = frameIndex;
+        Frame& frame = frames[index];
+        bool upload;
+        try {
+            prepareOffscreenBatch(polygonSets, triangulations, std::min(count, offscreenBatch), scale, offset);
+            upload = recordUploadCommandBuffer(frame);
+        } catch(...) {
+            abandonFrame(frame);
+            throw;
+        }
+        auto submitStart = std::chrono::steady_clock::now();
+        vk::CommandBuffer commandBuffers[] {frame.uploadCommandBuffer, frame.commandBuffers.front()};
+        std::unique_lock<std::mutex> queueLock(deviceContext->queueMutex);
+        device.resetFences({*frame.renderingCompleteFence});
+        queue.submit(vk::SubmitInfo{
+                /*waitSemaphoreCount*/   0,
+                /*pWaitSemaphores*/      nullptr,
+                /*pWaitDstStageMask*/    nullptr,
+                /*commandBufferCount*/   upload ? 2U : 1U,
+                /*pCommandBuffers*/      upload ? commandBuffers : commandBuffers + 1,
+                /*signalSemaphoreCount*/ 0,
+                /*pSignalSemaphores*/    nullptr
+        }, *frame.renderingCompleteFence);
+        queueLock.unlock();
+        frame.serial = ++submittedSerial;
+        finishFrameStatistics(frame, submitStart);
+        return index;
+    }
+
+    /** Waits until offscreen frame is rendered and returns pixels of its batch, images one after another as tightly packed RGBA rows */
+    const uint8_t* readback(uint32_t index) {
+        Frame& frame = frames[index];
+        device.waitForFences({*frame.renderingCompleteFence}, true, -1);
+        frame.readbackBuffer.invalidate(0, VK_WHOLE_SIZE);
+        return (const uint8_t*) frame.readbackBuffer.allocationInfo.pMappedData;
+    }
+
+    /** Enables timestamp and pipeline statistics queries, command buffers of all frames are recorded again.
+     * Stays disabled when queue doesn't support timestamps.
+     */
+    void setProfiling(bool enabled) {
+        if(timestampMask == 0) enabled = false;
+        if(enabled == profiling) return;
+        profiling = enabled;
+        statistics.clear();
+        for(Frame& frame : frames) {
+            device.waitForFences({*frame.renderingCompleteFence}, true, -1);
+            frame.queriesPending = false;
+            if(frame.targetOutdated) allocateCommandBuffers(frame);
+            recordCommandBuffers(frame);
+        }
+    }
+
+    /** Selects multisampling quality. Automatic mode writes timestamps to measure GPU frame time even without profiling,
+     * so command buffers of all frames are recorded again when they are reused.
+     */
+    void setAntialiasing(GraphicSettings::Antialiasing antialiasing) {
+        graphicSettings.antialiasing = antialiasing;
+        antialiasingMilliseconds = 0;
+        antialiasingFrames = 0;
+        antialiasingRecoveredWindows = 0;
+        updateSampleCount(graphicSettings.selectSampleCount(antialiasing));
+        for(Frame& frame : frames) frame.targetOutdated = true;
+    }
+
+    /** Changes how many frames CPU can prepare while GPU is still drawing previous ones. All frames are created again,
+     * so this waits for the ones in flight. Geometry buffers belong to frames, so geometry is uploaded again.
+     */
+    void setFramesInFlight(uint32_t count) {
+        count = std::max(count, 1U);
+        if(count == frames.size()) return;
+        for(Frame& frame : frames) device.waitForFences({*frame.renderingCompleteFence}, true, -1);
+        completedSerial = submittedSerial;
+        releaseRetiredTargets();
+        stagingRing.retire(stagingRing.position());
+
+        frames.clear();
+        descriptorPool = {};
+        frameIndex = 0;
+        graphicSettings.framesInFlight = count;
+        createFrames();
+        // Offscreen images belong to frames, swapchain targets are only waiting for command buffers
+        if(offscreen) {
+            if(targetContext.extent.width != 0 && targetContext.extent.height != 0) updateOffscreenContext(targetContext.extent);
+        }
+        else for(Frame& frame : frames) frame.targetOutdated = true;
+    }
+
+    /** Averages over last frames, results arrive with a delay of frames in flight */
+    [[nodiscard]] FrameStatistics getStatistics() const {
+        return statistics.average();
+    }
+
+    [[nodiscard]] vk::Extent2D extent() const {
+        return targetContext.extent;
     }
 
 
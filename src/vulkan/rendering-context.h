@@ -2,6 +2,9 @@
 
 
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 
 
 #include "graphic-settings.h"
@@ -12,15 +15,55 @@ extern const uint32_t APP_VK_VERSION;
 
 
 
-struct RenderingContext {
+/** Device with its queue and allocator, shared by all renderers of the process while any of them exists.
+ * Queue must be externally synchronized, so renderers submit and present under queueMutex.
+ */
+struct DeviceContext {
 
     vk::UniqueDevice device;
     uint32_t queueFamily {};
     vk::Queue queue;
+    std::mutex queueMutex;
+    /** Properties of physical device without surface, every renderer keeps its own copy with surface */
     PhysicalDeviceProperties physicalDeviceProperties;
-    GraphicSettings graphicSettings;
+    bool swapchainSupported {false};
+    /** Indirect draws can take their count from a buffer, so GPU culling doesn't have to issue empty draws */
+    bool drawIndirectCountSupported {false};
     vma::Allocator vma;
 
+    /** Pipeline objects depend only on device, they are created by the first renderer and guarded by pipelineMutex.
+     * Graphics pipelines are created per image format and sample count, renderers use them with their own
+     * compatible render passes.
+     */
+    struct GraphicsPipelines {
+        vk::UniquePipeline triangle, triangleEdge, polygonEdge, vertexMarker;
+    };
+    std::mutex pipelineMutex;
+    vk::UniquePipelineCache pipelineCache;
+    /** Pipeline cache started with data of a previous run, reported with pipeline creation time in debug builds */
+    bool pipelineCacheWarm {false};
+    vk::UniqueDescriptorSetLayout descriptorSetLayout, cullDescriptorSetLayout;
+    vk::UniquePipelineLayout pipelineLayout, cullPipelineLayout;
+    vk::UniqueShaderModule vertexShader, triangleFragmentShader, flatFragmentShader, vertexMarkerVertexShader, vertexMarkerFragmentShader;
+    vk::UniqueShaderModule cullShader;
+    vk::UniquePipeline cullPipeline;
+    std::map<std::pair<vk::Format, vk::SampleCountFlagBits>, std::shared_ptr<const GraphicsPipelines>> graphicsPipelines;
+
+};
+
+
+
+/** Handles of shared device context together with surface properties and graphic settings of one renderer */
+struct RenderingContext {
+
+    std::shared_ptr<DeviceContext> deviceContext;
+    vk::Device device;
+    uint32_t queueFamily {};
+    vk::Queue queue;
+    PhysicalDeviceProperties physicalDeviceProperties;
+    GraphicSettings graphicSettings;
+    VmaAllocator vma {VK_NULL_HANDLE};
+
 };
 
 
@@ -29,7 +72,7 @@ static int findApplicableQueueFamily(const vk::PhysicalDevice physicalDevice, co
     std::vector<vk::QueueFamilyProperties> familyProperties = physicalDevice.getQueueFamilyProperties();
     for (int i = 0; i < familyProperties.size(); i++) {
         vk::QueueFamilyProperties& family = familyProperties[i];
-        if(physicalDevice.getSurfaceSupportKHR(i, surface) &&
+        if((!surface || physicalDevice.getSurfaceSupportKHR(i, surface)) &&
            (family.queueFlags & vk::QueueFlagBits::eGraphics) == vk::QueueFlagBits::eGraphics)
             return i;
     }
@@ -38,13 +81,16 @@ static int findApplicableQueueFamily(const vk::PhysicalDevice physicalDevice, co
 
 
 
-static RenderingContext createRenderingContext(vk::Instance vk, vk::SurfaceKHR surface) {
+/** Picks device applicable for given surface. Surface may be null for offscreen rendering, then swapchain extension
+ * is not required, but it's still enabled when supported, so that the device can be shared with windowed renderers.
+ */
+static std::shared_ptr<DeviceContext> createDeviceContext(vk::Instance vk, vk::SurfaceKHR surface) {
     for (const vk::PhysicalDevice& physicalDevice : vk.enumeratePhysicalDevices()) {
 
-        RenderingContext renderingContext;
+        auto deviceContext = std::make_shared<DeviceContext>();
 
-        renderingContext.physicalDeviceProperties = {physicalDevice, surface};
-        std::cout << "Found device: " << renderingContext.physicalDeviceProperties.physicalDeviceProperties.deviceName << std::endl;
+        deviceContext->physicalDeviceProperties = {physicalDevice, surface};
+        std::cout << "Found device: " << deviceContext->physicalDeviceProperties.physicalDeviceProperties.deviceName << std::endl;
 
 
         // Ensure device supports all necessary layers
@@ -68,6 +114,8 @@ static RenderingContext createRenderingContext(vk::Instance vk, vk::SurfaceKHR s
         bool swapchainExtensionFound = false;
         std::string dedicatedAllocationExtensionName = VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME;
         std::string getMemoryRequirements2ExtensionName = VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME;
+        std::string drawIndirectCountExtensionName = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+        bool drawIndirectCountExtensionFound = false;
         std::vector<const char*> extensionNamePointers;
         for(vk::ExtensionProperties& extensionProperties : supportedExtensions) {
             if(std::strcmp(swapchainExtensionName.c_str(), extensionProperties.extensionName) == 0) {
@@ -79,24 +127,29 @@ static RenderingContext createRenderingContext(vk::Instance vk, vk::SurfaceKHR s
             if(std::strcmp(getMemoryRequirements2ExtensionName.c_str(), extensionProperties.extensionName) == 0) {
                 extensionNamePointers.push_back(getMemoryRequirements2ExtensionName.c_str());
             }
+            if(std::strcmp(drawIndirectCountExtensionName.c_str(), extensionProperties.extensionName) == 0) {
+                drawIndirectCountExtensionFound = true;
+            }
         }
         bool dedicatedAllocationExtensionSupported = extensionNamePointers.size() == 2;
-        if(!swapchainExtensionFound) {
+        if(surface && !swapchainExtensionFound) {
             std::cerr << "Device swapchain extension not found" << std::endl;
             continue;
         }
-        extensionNamePointers.push_back(swapchainExtensionName.c_str());
+        if(swapchainExtensionFound) extensionNamePointers.push_back(swapchainExtensionName.c_str());
+        if(drawIndirectCountExtensionFound) extensionNamePointers.push_back(drawIndirectCountExtensionName.c_str());
 
 
         // Check Vulkan version
-        if(renderingContext.physicalDeviceProperties.physicalDeviceProperties.apiVersion < APP_VK_VERSION) {
+        if(deviceContext->physicalDeviceProperties.physicalDeviceProperties.apiVersion < APP_VK_VERSION) {
             std::cerr << "Too old driver version" << std::endl;
             continue;
         }
 
-        // Setup graphic settings
+        // Check graphic settings, they are set up again by every renderer
         try {
-            renderingContext.graphicSettings.validate(renderingContext.physicalDeviceProperties);
+            GraphicSettings graphicSettings;
+            graphicSettings.validate(deviceContext->physicalDeviceProperties);
         } catch(const GraphicRequirementsNotSatisfiedException& e) {
             std::cerr << e.what() << std::endl;
             continue;
@@ -123,11 +176,13 @@ static RenderingContext createRenderingContext(vk::Instance vk, vk::SurfaceKHR s
         vk::PhysicalDeviceFeatures physicalDeviceFeatures {};
         physicalDeviceFeatures.fillModeNonSolid = true;
         physicalDeviceFeatures.wideLines = true;
-        physicalDeviceFeatures.geometryShader = true;
+        physicalDeviceFeatures.drawIndirectFirstInstance = deviceContext->physicalDeviceProperties.physicalDeviceFeatures.drawIndirectFirstInstance;
+        physicalDeviceFeatures.multiDrawIndirect = deviceContext->physicalDeviceProperties.physicalDeviceFeatures.multiDrawIndirect;
+        physicalDeviceFeatures.pipelineStatisticsQuery = deviceContext->physicalDeviceProperties.physicalDeviceFeatures.pipelineStatisticsQuery;
 
         const char* validationLayerNamePointer = validationLayerName.c_str();
 
-        renderingContext.device = renderingContext.physicalDeviceProperties.physicalDevice.createDeviceUnique(vk::DeviceCreateInfo{
+        deviceContext->device = physicalDevice.createDeviceUnique(vk::DeviceCreateInfo{
                 /*flags*/                   {},
                 /*queueCreateInfoCount*/    1,
                 /*pQueueCreateInfos*/       &queueCreateInfo,
@@ -137,13 +192,52 @@ static RenderingContext createRenderingContext(vk::Instance vk, vk::SurfaceKHR s
                 /*ppEnabledExtensionNames*/ extensionNamePointers.data(),
                 /*pEnabledFeatures*/        &physicalDeviceFeatures
         });
-        renderingContext.queueFamily = queueFamily;
-        renderingContext.queue = renderingContext.device->getQueue(queueFamily, 0);
+        deviceContext->queueFamily = queueFamily;
+        deviceContext->queue = deviceContext->device->getQueue(queueFamily, 0);
+        deviceContext->physicalDeviceProperties = {physicalDevice, vk::SurfaceKHR()};
+        deviceContext->swapchainSupported = swapchainExtensionFound;
+        deviceContext->drawIndirectCountSupported = drawIndirectCountExtensionFound;
 
-        renderingContext.vma = createVmaAllocator(vk, physicalDevice, *renderingContext.device, dedicatedAllocationExtensionSupported, APP_VK_VERSION);
+        deviceContext->vma = createVmaAllocator(vk, physicalDevice, *deviceContext->device, dedicatedAllocationExtensionSupported, APP_VK_VERSION);
 
-        return renderingContext;
+        return deviceContext;
 
     }
     throw std::runtime_error("No applicable device found");
+}
+
+
+
+/** Reuses device of existing renderers when it can present to given surface, otherwise creates a new one.
+ * Function is inline rather than static, so that all translation units share the same device.
+ * Only the first device is shared, device created for incompatible surface lives with its renderer.
+ */
+inline std::shared_ptr<DeviceContext> acquireDeviceContext(vk::Instance vk, vk::SurfaceKHR surface) {
+    static std::mutex mutex;
+    static std::weak_ptr<DeviceContext> sharedContext;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::shared_ptr<DeviceContext> context = sharedContext.lock();
+    if(context) {
+        vk::PhysicalDevice physicalDevice = context->physicalDeviceProperties.physicalDevice;
+        if(!surface || (context->swapchainSupported && physicalDevice.getSurfaceSupportKHR(context->queueFamily, surface))) return context;
+        return createDeviceContext(vk, surface);
+    }
+    context = createDeviceContext(vk, surface);
+    sharedContext = context;
+    return context;
+}
+
+
+
+static RenderingContext createRenderingContext(vk::Instance vk, vk::SurfaceKHR surface) {
+    RenderingContext renderingContext;
+    renderingContext.deviceContext = acquireDeviceContext(vk, surface);
+    renderingContext.device = *renderingContext.deviceContext->device;
+    renderingContext.queueFamily = renderingContext.deviceContext->queueFamily;
+    renderingContext.queue = renderingContext.deviceContext->queue;
+    renderingContext.physicalDeviceProperties = {renderingContext.deviceContext->physicalDeviceProperties.physicalDevice, surface};
+    renderingContext.graphicSettings.validate(renderingContext.physicalDeviceProperties);
+    renderingContext.vma = *renderingContext.deviceContext->vma;
+    return renderingContext;
 }
\ No newline at end of file
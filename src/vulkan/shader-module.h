@@ -3,10 +3,12 @@
 
 namespace resource::shader {
 
-    extern const std::vector<unsigned char> triangle_vertex_geom;
     extern const std::vector<unsigned char> flat_frag;
     extern const std::vector<unsigned char> triangle_frag;
     extern const std::vector<unsigned char> main_vert;
+    extern const std::vector<unsigned char> vertex_marker_vert;
+    extern const std::vector<unsigned char> vertex_marker_frag;
+    extern const std::vector<unsigned char> cull_comp;
 
 }
 
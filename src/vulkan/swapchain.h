@@ -24,7 +24,7 @@ public:
         vk::SurfaceCapabilitiesKHR surfaceCapabilities = renderingContext.physicalDeviceProperties.getSurfaceCapabilities();
         vk::Extent2D extent = surfaceCapabilities.currentExtent;
         if(extent.width == -1 || extent.height == -1) extent = surfaceCapabilities.maxImageExtent;
-        vk::UniqueSwapchainKHR newSurface = renderingContext.device->createSwapchainKHRUnique(vk::SwapchainCreateInfoKHR{
+        vk::UniqueSwapchainKHR newSurface = renderingContext.device.createSwapchainKHRUnique(vk::SwapchainCreateInfoKHR{
                 /*flags*/                 {},
                 /*surface*/               renderingContext.physicalDeviceProperties.surface,
                 /*minImageCount*/         renderingContext.graphicSettings.minImageCount,
@@ -42,7 +42,7 @@ public:
                 /*clipped*/               true,
                 /*oldSwapchain*/          !oldSwapchain.handle ? vk::SwapchainKHR() : *(oldSwapchain.handle)
         });
-        std::vector<vk::Image> images = renderingContext.device->getSwapchainImagesKHR(*newSurface);
+        std::vector<vk::Image> images = renderingContext.device.getSwapchainImagesKHR(*newSurface);
 
         vk::ImageViewCreateInfo imageViewCreateInfo{
                 /*flags*/            {},
@@ -61,10 +61,10 @@ public:
         std::vector<vk::UniqueImageView> imageViews(images.size());
         for (size_t i = 0; i < images.size(); i++) {
             imageViewCreateInfo.image = images[i];
-            imageViews[i] = renderingContext.device->createImageViewUnique(imageViewCreateInfo);
+            imageViews[i] = renderingContext.device.createImageViewUnique(imageViewCreateInfo);
         }
 
-        return Swapchain(std::move(newSurface), surfaceCapabilities.currentExtent, std::move(images), std::move(imageViews));
+        return Swapchain(std::move(newSurface), extent, std::move(images), std::move(imageViews));
     }
 
 
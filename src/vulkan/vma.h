@@ -1,6 +1,8 @@
 #pragma once
 
 
+#include <optional>
+
 #include "physical-device-properties.h"
 
 
@@ -72,10 +74,11 @@ namespace vma {
         inline vk::Buffer& operator*() noexcept { return handle; }
         inline const vk::Buffer& operator*() const noexcept { return handle; }
 
-        StreamBuffer(const Allocator& allocator, const vk::BufferCreateInfo& bufferCreateInfo) : vma(*allocator){
+        StreamBuffer(VmaAllocator allocator, const vk::BufferCreateInfo& bufferCreateInfo,
+                VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU) : vma(allocator){
             VmaAllocationCreateInfo allocationCreateInfo{
                     /*flags*/          VMA_ALLOCATION_CREATE_MAPPED_BIT,
-                    /*usage*/          VMA_MEMORY_USAGE_CPU_TO_GPU,
+                    /*usage*/          memoryUsage,
                     /*requiredFlags*/  0,
                     /*preferredFlags*/ 0,
                     /*memoryTypeBits*/ 0,
@@ -93,6 +96,124 @@ namespace vma {
             vmaFlushAllocation(vma, allocation, offset, size);
         }
 
+        void invalidate(VkDeviceSize offset, VkDeviceSize size) {
+            vmaInvalidateAllocation(vma, allocation, offset, size);
+        }
+
+    };
+
+
+
+
+    /** Persistently mapped buffer, which hands out sub-allocations in ring order. Positions grow monotonically
+     * and are wrapped around capacity, allocated regions are released in the same order by retire(position),
+     * usually once fence of the frame which used them is signaled.
+     */
+    class RingBuffer {
+
+        StreamBuffer buffer;
+        vk::DeviceSize head {0}, tail {0};
+
+    public:
+        inline RingBuffer() = default;
+        inline operator bool() const { return buffer; } // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        inline vk::Buffer& operator*() noexcept { return *buffer; }
+        inline const vk::Buffer& operator*() const noexcept { return *buffer; }
+
+        RingBuffer(VmaAllocator allocator, vk::DeviceSize capacity, vk::BufferUsageFlags usage,
+                VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY) :
+        buffer(allocator, vk::BufferCreateInfo{
+                /*flags*/                 {},
+                /*size*/                  capacity,
+                /*usage*/                 usage,
+                /*sharingMode*/           vk::SharingMode::eExclusive,
+                /*queueFamilyIndexCount*/ 0,
+                /*pQueueFamilyIndices*/   nullptr
+        }, memoryUsage) {}
+
+        inline vk::DeviceSize capacity() const { return buffer.allocationInfo.size; }
+        inline void* data(vk::DeviceSize offset) { return (char*) buffer.allocationInfo.pMappedData + offset; }
+
+        /** Current position, everything allocated so far can be released by passing it to retire() */
+        inline vk::DeviceSize position() const { return head; }
+
+        inline void retire(vk::DeviceSize position) {
+            if(position > tail) tail = position;
+        }
+
+        /** Returns offset of allocated region, or nothing if there is not enough free space */
+        std::optional<vk::DeviceSize> allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+            vk::DeviceSize base = head - head % capacity();
+            vk::DeviceSize offset = (head - base + alignment - 1) / alignment * alignment;
+            // Regions never wrap around, so if it doesn't fit at the end, rest of the buffer is skipped
+            if(offset + size > capacity()) {
+                base += capacity();
+                offset = 0;
+            }
+            if(size > capacity() || base + offset + size - tail > capacity()) return std::nullopt;
+            head = base + offset + size;
+            return offset;
+        }
+
+        /** Flushes region written by host, which must not wrap around */
+        void flush(vk::DeviceSize offset, vk::DeviceSize size) {
+            buffer.flush(offset, size);
+        }
+
+    };
+
+
+
+    /** Buffer in device-local memory, which is not accessible by host and must be filled by transfer commands. */
+    class DeviceBuffer {
+
+        VmaAllocator vma {VK_NULL_HANDLE};
+        VmaAllocation allocation {VK_NULL_HANDLE};
+        vk::Buffer handle;
+
+    public:
+        VmaAllocationInfo allocationInfo {};
+
+        inline DeviceBuffer() = default;
+        inline DeviceBuffer(const DeviceBuffer&) = delete;
+        inline DeviceBuffer& operator=(const DeviceBuffer&) = delete;
+        inline DeviceBuffer(DeviceBuffer&& a) noexcept {
+            vma = a.vma;
+            allocation = a.allocation;
+            handle = a.handle;
+            allocationInfo = a.allocationInfo;
+            a.handle = vk::Buffer();
+        }
+        inline DeviceBuffer& operator=(DeviceBuffer&& a) noexcept {
+            if(handle) vmaDestroyBuffer(vma, handle, allocation);
+            vma = a.vma;
+            allocation = a.allocation;
+            handle = a.handle;
+            allocationInfo = a.allocationInfo;
+            a.handle = vk::Buffer();
+            return *this;
+        }
+        inline operator bool() const { return handle; } // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        inline vk::Buffer& operator*() noexcept { return handle; }
+        inline const vk::Buffer& operator*() const noexcept { return handle; }
+
+        DeviceBuffer(VmaAllocator allocator, const vk::BufferCreateInfo& bufferCreateInfo) : vma(allocator){
+            VmaAllocationCreateInfo allocationCreateInfo{
+                    /*flags*/          0,
+                    /*usage*/          VMA_MEMORY_USAGE_GPU_ONLY,
+                    /*requiredFlags*/  0,
+                    /*preferredFlags*/ 0,
+                    /*memoryTypeBits*/ 0,
+                    /*pool*/           VK_NULL_HANDLE,
+                    /*pUserData*/      nullptr
+            };
+            vk::createResultValue((vk::Result) vmaCreateBuffer(vma, (VkBufferCreateInfo*) &bufferCreateInfo,
+                    &allocationCreateInfo, (VkBuffer*) &handle, &allocation, &allocationInfo), "Buffer allocation error");
+        }
+        ~DeviceBuffer() {
+            if(handle) vmaDestroyBuffer(vma, handle, allocation);
+        }
+
     };
 
 
@@ -139,13 +260,15 @@ namespace vma {
         inline vk::Image& operator*() noexcept { return handle; }
         inline const vk::Image& operator*() const noexcept { return handle; }
 
-        UnmappedImage(vk::Device device, const Allocator& allocator, const vk::ImageCreateInfo& imageCreateInfo,
-                const vk::ImageViewCreateInfo& imageViewCreateInfo) : vma(*allocator), device(device) {
+        /** Transient attachments prefer lazily allocated memory, which may never be backed when contents stay on chip */
+        UnmappedImage(vk::Device device, VmaAllocator allocator, const vk::ImageCreateInfo& imageCreateInfo,
+                const vk::ImageViewCreateInfo& imageViewCreateInfo) : vma(allocator), device(device) {
+            bool transient = (imageCreateInfo.usage & vk::ImageUsageFlagBits::eTransientAttachment) == vk::ImageUsageFlagBits::eTransientAttachment;
             VmaAllocationCreateInfo allocationCreateInfo{
                     /*flags*/          0,
                     /*usage*/          VMA_MEMORY_USAGE_GPU_ONLY,
                     /*requiredFlags*/  0,
-                    /*preferredFlags*/ 0,
+                    /*preferredFlags*/ transient ? (VkMemoryPropertyFlags) VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0,
                     /*memoryTypeBits*/ 0,
                     /*pool*/           VK_NULL_HANDLE,
                     /*pUserData*/      nullptr
@@ -17,6 +17,8 @@ VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
 static vk::DynamicLoader* dynamicLoader;
 vk::Instance vkInstance;
+/** Surface extensions are optional, so that offscreen rendering works on machines without any display */
+bool vkSurfaceSupported {false};
 
 
 
@@ -68,6 +70,7 @@ static vk::Instance createVkInstance() {
     std::string platformSurfaceExtensionName = PLATFORM_SPECIFIC_SURFACE_EXTENSION_NAME;
     std::string physicalDeviceProperties2ExtensionName = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
     std::vector<const char*> extensionNamePointers;
+    bool surfaceExtensionFound = false, platformSurfaceExtensionFound = false;
     for(vk::ExtensionProperties& extensionProperties : supportedExtensions) {
 #if !defined(NDEBUG)
         if(std::strcmp(debugUtilsExtensionName.c_str(), extensionProperties.extensionName) == 0) {
@@ -75,16 +78,22 @@ static vk::Instance createVkInstance() {
         }
 #endif
         if(std::strcmp(surfaceExtensionName.c_str(), extensionProperties.extensionName) == 0) {
-            extensionNamePointers.push_back(surfaceExtensionName.c_str());
+            surfaceExtensionFound = true;
         }
         if(std::strcmp(platformSurfaceExtensionName.c_str(), extensionProperties.extensionName) == 0) {
-            extensionNamePointers.push_back(platformSurfaceExtensionName.c_str());
+            platformSurfaceExtensionFound = true;
         }
         if(std::strcmp(physicalDeviceProperties2ExtensionName.c_str(), extensionProperties.extensionName) == 0) {
             extensionNamePointers.push_back(physicalDeviceProperties2ExtensionName.c_str());
         }
     }
-    if(extensionNamePointers.size() < 3) throw std::runtime_error("Required extensions were not found");
+    if(extensionNamePointers.empty()) throw std::runtime_error("Required extensions were not found");
+    vkSurfaceSupported = surfaceExtensionFound && platformSurfaceExtensionFound;
+    if(vkSurfaceSupported) {
+        extensionNamePointers.push_back(surfaceExtensionName.c_str());
+        extensionNamePointers.push_back(platformSurfaceExtensionName.c_str());
+    }
+    else std::cerr << "Instance surface extensions not found, only offscreen rendering is available" << std::endl;
 #if !defined(NDEBUG)
     if(debugUtilsExtensionFound) extensionNamePointers.push_back(debugUtilsExtensionName.c_str());
     else std::cerr << "Instance debug utils extension not found" << std::endl;